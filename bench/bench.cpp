@@ -1,5 +1,6 @@
 #include "../utils/datautils.hpp"
 #include "../utils/common.hpp"
+#include "../utils/parallel.hpp"
 
 #include "../indexes/nonlearned/nonlearned_index.hpp"
 #include "../indexes/learned/learned_index.hpp"
@@ -29,6 +30,7 @@ using Box = box_t<BENCH_DIM>;
 // non-learned indices
 using RTree = bench::index::RTree<BENCH_DIM>;
 using RStarTree = bench::index::RStarTree<BENCH_DIM>;
+using FlatRTree = bench::index::FlatRTree<BENCH_DIM>;
 using KDTree = bench::index::KDTree<BENCH_DIM>;
 using ANNKDTree = bench::index::ANNKDTree<BENCH_DIM>;
 using QDTree = bench::index::QDTree<BENCH_DIM>;
@@ -48,10 +50,12 @@ using MLI = bench::index::MLIndex<BENCH_DIM, INDEX_ERROR_THRESHOLD>;
 using IFI = bench::index::IFIndex<BENCH_DIM>;
 using Flood = bench::index::Flood<BENCH_DIM, PARTITION_NUM, INDEX_ERROR_THRESHOLD>;
 using Lisa = bench::index::LISA2<BENCH_DIM, PARTITION_NUM, INDEX_ERROR_THRESHOLD>;          
+using LisaKD = bench::index::LISA2<BENCH_DIM, PARTITION_NUM, INDEX_ERROR_THRESHOLD, bench::index::KDCells>;
 
 struct IndexSet {
     RTree*     rtree;
     RStarTree* rstartree;
+    FlatRTree* flatrtree;
     KDTree*    kdtree;
     ANNKDTree* annkdtree;
     QDTree*    qdtree;
@@ -63,10 +67,12 @@ struct IndexSet {
     IFI*       ifi;
     Flood*     flood;
     Lisa*      lisa;
+    LisaKD*    lisakd;
 
     IndexSet() : 
         rtree(nullptr), 
         rstartree(nullptr),
+        flatrtree(nullptr),
         kdtree(nullptr),
         annkdtree(nullptr),
         qdtree(nullptr),
@@ -77,10 +83,13 @@ struct IndexSet {
         mli(nullptr),
         ifi(nullptr),
         flood(nullptr),
-        lisa(nullptr) {}
+        lisa(nullptr),
+        lisakd(nullptr) {}
 
     ~IndexSet() {
         delete rtree;
+        delete rstartree;
+        delete flatrtree;
         delete kdtree;
         delete annkdtree;
         delete qdtree;
@@ -92,11 +101,14 @@ struct IndexSet {
         delete ifi;
         delete flood;
         delete lisa;
+        delete lisakd;
     }
 };
 
 
-static void build_index(IndexSet& idx_set, const std::string& idx_name, Points& points) {
+// workload is a sample of range queries for the indexes tuned to the query workload,
+// held out from the timed range queries
+static void build_index(IndexSet& idx_set, const std::string& idx_name, Points& points, const std::vector<Box>& workload) {
     if (idx_name.compare("rtree") == 0) {
         idx_set.rtree = new RTree(points);
         return;
@@ -107,6 +119,16 @@ static void build_index(IndexSet& idx_set, const std::string& idx_name, Points&
         return;
     }
 
+    if (idx_name.compare("rstarpacked") == 0) {
+        idx_set.rstartree = new RStarTree(points, true);
+        return;
+    }
+
+    if (idx_name.compare("flatrtree") == 0) {
+        idx_set.flatrtree = new FlatRTree(points);
+        return;
+    }
+
     if (idx_name.compare("kdtree") == 0) {
         idx_set.kdtree = new KDTree(points);
         return;
@@ -143,16 +165,21 @@ static void build_index(IndexSet& idx_set, const std::string& idx_name, Points&
     }
 
     if (idx_name.compare("mli") == 0) {
-        idx_set.mli = new MLI(points);
+        idx_set.mli = new MLI(points, 0, workload);
         return;
     }
 
     if (idx_name.compare("ifi") == 0) {
-        idx_set.ifi = new IFI(points);
+        idx_set.ifi = new IFI(points, workload);
         return;
     }
 
     if (idx_name.compare("flood") == 0) {
+        idx_set.flood = new Flood(points, workload);
+        return;
+    }
+
+    if (idx_name.compare("floodfixed") == 0) {
         idx_set.flood = new Flood(points);
         return;
     }
@@ -162,7 +189,12 @@ static void build_index(IndexSet& idx_set, const std::string& idx_name, Points&
         return;
     }
 
-    std::cout << "index name should be one of [rtree, rstar, kdtree, ann, qdtree, ug, edg, fs, zm, mli, ifi, flood, lisa]" << std::endl;
+    if (idx_name.compare("lisakd") == 0) {
+        idx_set.lisakd = new LisaKD(points);
+        return;
+    }
+
+    std::cout << "index name should be one of [rtree, rstar, rstarpacked, flatrtree, kdtree, ann, qdtree, ug, edg, fs, zm, mli, ifi, flood, floodfixed, lisa, lisakd]" << std::endl;
     exit(0);
 }
 
@@ -173,17 +205,21 @@ int main(int argc, char **argv) {
     std::string index = argv[1]; // index name
     std::string fname = argv[2]; // data file name
     size_t N = std::stoi(argv[3]); // dataset size
-    std::string mode = argv[4]; // bench mode {"range", "knn", "all"}
+    std::string mode = argv[4]; // bench mode {"range", "knn", "all", "insert"}
+    size_t threads = (argc > 5) ? std::stoi(argv[5]) : 0; // build threads, 0 for all cores
+
+    bench::common::set_build_threads(threads);
 
     std::cout << "====================================" << std::endl;
     std::cout << "Load data: " << fname << std::endl;
+    std::cout << "Build Threads: " << bench::common::build_threads() << std::endl;
 
     Points points;
     bench::utils::read_points(points, fname, N);
     IndexSet idx_set;
 
 #ifdef HEAP_PROFILE
-    build_index(idx_set, index, points);
+    build_index(idx_set, index, points, {});
     return 0;
 #endif
 
@@ -192,7 +228,17 @@ int main(int argc, char **argv) {
     auto range_queries = bench::query::sample_range_queries(points);
     auto knn_queries = bench::query::sample_knn_queries(points);
 
-    build_index(idx_set, index, points);
+    auto workload = bench::query::sample_tuning_workload(points, range_queries);
+
+    // in insert mode the index is built on the first half of the points and the second half is inserted,
+    // the queries are sampled on all points
+    Points inserts;
+    if (mode.compare("insert") == 0) {
+        inserts.assign(points.begin() + points.size() / 2, points.end());
+        points.resize(points.size() / 2);
+    }
+
+    build_index(idx_set, index, points, workload);
     
 
     if (index.compare("rtree") == 0) {
@@ -210,9 +256,15 @@ int main(int argc, char **argv) {
             bench::query::batch_knn_queries(*(idx_set.rtree), knn_queries);
             return 0;
         }
+        if (mode.compare("insert") == 0) {
+            bench::query::batch_inserts(*(idx_set.rtree), inserts);
+            bench::query::batch_range_queries(*(idx_set.rtree), range_queries);
+            bench::query::batch_removes(*(idx_set.rtree), inserts);
+            return 0;
+        }
     }
 
-    if (index.compare("rstar") == 0) {
+    if (index.compare("rstar") == 0 || index.compare("rstarpacked") == 0) {
         assert(idx_set.rstartree != nullptr);
         if (mode.compare("range") == 0) {
             bench::query::batch_range_queries(*(idx_set.rstartree), range_queries);
@@ -227,6 +279,29 @@ int main(int argc, char **argv) {
             bench::query::batch_knn_queries(*(idx_set.rstartree), knn_queries);
             return 0;
         }
+        if (mode.compare("insert") == 0) {
+            bench::query::batch_inserts(*(idx_set.rstartree), inserts);
+            bench::query::batch_range_queries(*(idx_set.rstartree), range_queries);
+            bench::query::batch_removes(*(idx_set.rstartree), inserts);
+            return 0;
+        }
+    }
+
+    if (index.compare("flatrtree") == 0) {
+        assert(idx_set.flatrtree != nullptr);
+        if (mode.compare("range") == 0) {
+            bench::query::batch_range_queries(*(idx_set.flatrtree), range_queries);
+            return 0;
+        }
+        if (mode.compare("knn") == 0) {
+            bench::query::batch_knn_queries(*(idx_set.flatrtree), knn_queries);
+            return 0;
+        }
+        if (mode.compare("all") == 0) {
+            bench::query::batch_range_queries(*(idx_set.flatrtree), range_queries);
+            bench::query::batch_knn_queries(*(idx_set.flatrtree), knn_queries);
+            return 0;
+        }
     }
 
     if (index.compare("kdtree") == 0) {
@@ -289,7 +364,7 @@ int main(int argc, char **argv) {
     if (index.compare("zm") == 0) {
         assert(idx_set.zm != nullptr);
         if (mode.compare("range") == 0) {
-            bench::query::batch_range_queries(*(idx_set.zm), range_queries);
+            bench::query::batch_range_queries(*(idx_set.zm), range_queries, false);
             return 0;
         }
         if (mode.compare("knn") == 0) {
@@ -297,7 +372,7 @@ int main(int argc, char **argv) {
             return 0;
         }
         if (mode.compare("all") == 0) {
-            bench::query::batch_range_queries(*(idx_set.zm), range_queries);
+            bench::query::batch_range_queries(*(idx_set.zm), range_queries, false);
             bench::query::batch_knn_queries(*(idx_set.zm), knn_queries);
             return 0;
         }
@@ -326,14 +401,32 @@ int main(int argc, char **argv) {
             bench::query::batch_range_queries(*(idx_set.ifi), range_queries);
             return 0;
         }
+        if (mode.compare("knn") == 0) {
+            bench::query::batch_knn_queries(*(idx_set.ifi), knn_queries);
+            return 0;
+        }
+        if (mode.compare("all") == 0) {
+            bench::query::batch_range_queries(*(idx_set.ifi), range_queries);
+            bench::query::batch_knn_queries(*(idx_set.ifi), knn_queries);
+            return 0;
+        }
     }
 
-    if (index.compare("flood") == 0) {
+    if (index.compare("flood") == 0 || index.compare("floodfixed") == 0) {
         assert(idx_set.flood != nullptr);
         if (mode.compare("range") == 0) {
             bench::query::batch_range_queries(*(idx_set.flood), range_queries);
             return 0;
         }
+        if (mode.compare("knn") == 0) {
+            bench::query::batch_knn_queries(*(idx_set.flood), knn_queries);
+            return 0;
+        }
+        if (mode.compare("all") == 0) {
+            bench::query::batch_range_queries(*(idx_set.flood), range_queries);
+            bench::query::batch_knn_queries(*(idx_set.flood), knn_queries);
+            return 0;
+        }
     }
 
     if (index.compare("lisa") == 0) {
@@ -351,6 +444,35 @@ int main(int argc, char **argv) {
             bench::query::batch_knn_queries(*(idx_set.lisa), knn_queries);
             return 0;
         }
+        if (mode.compare("insert") == 0) {
+            bench::query::batch_inserts(*(idx_set.lisa), inserts);
+            bench::query::batch_range_queries(*(idx_set.lisa), range_queries);
+            bench::query::batch_removes(*(idx_set.lisa), inserts);
+            return 0;
+        }
+    }
+
+    if (index.compare("lisakd") == 0) {
+        assert(idx_set.lisakd != nullptr);
+        if (mode.compare("range") == 0) {
+            bench::query::batch_range_queries(*(idx_set.lisakd), range_queries);
+            return 0;
+        }
+        if (mode.compare("knn") == 0) {
+            bench::query::batch_knn_queries(*(idx_set.lisakd), knn_queries);
+            return 0;
+        }
+        if (mode.compare("all") == 0) {
+            bench::query::batch_range_queries(*(idx_set.lisakd), range_queries);
+            bench::query::batch_knn_queries(*(idx_set.lisakd), knn_queries);
+            return 0;
+        }
+        if (mode.compare("insert") == 0) {
+            bench::query::batch_inserts(*(idx_set.lisakd), inserts);
+            bench::query::batch_range_queries(*(idx_set.lisakd), range_queries);
+            bench::query::batch_removes(*(idx_set.lisakd), inserts);
+            return 0;
+        }
     }
 
 #endif
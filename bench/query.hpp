@@ -14,9 +14,9 @@ namespace bench { namespace query {
 // sample queries from data
 // sample point queries
 template<size_t dim>
-static std::vector<point_t<dim>> sample_point_queries(vec_of_point_t<dim>& points, size_t s=100) {
+static std::vector<point_t<dim>> sample_point_queries(vec_of_point_t<dim>& points, size_t s=100, unsigned seed=0) {
     // seed the generator
-    std::mt19937 gen(0); 
+    std::mt19937 gen(seed); 
     std::uniform_int_distribution<> uint_dist(0, points.size()-1);
 
     // generate random indices
@@ -72,19 +72,17 @@ static std::pair<point_t<dim>, point_t<dim>> min_and_max(std::vector<point_t<dim
 }
 
 
-// sample range queries
-// selectivity = range_count(q_box) / N
+// sample range query boxes
 // for each selectivity we generate s=10 random boxes roughly match the selectivity
 template<size_t dim>
-static std::vector<std::pair<box_t<dim>, size_t>> sample_range_queries(vec_of_point_t<dim>& points, size_t s=10) {
+static std::vector<box_t<dim>> sample_range_boxes(vec_of_point_t<dim>& points, size_t s=10, unsigned seed=0) {
     double selectivities[5] = {0.001, 0.01, 0.05, 0.1, 0.2};
-    auto corner_points = sample_point_queries(points, s);
-    bench::index::FullScan<dim> fs(points);
+    auto corner_points = sample_point_queries(points, s, seed);
     
     std::pair<point_t<dim>, point_t<dim>> min_max = min_and_max(points);
 
-    std::vector<std::pair<box_t<dim>, size_t>> range_queries;
-    range_queries.reserve(5 * s);
+    std::vector<box_t<dim>> boxes;
+    boxes.reserve(5 * s);
     
     for (int i=0; i<5; ++i) {
         for (auto& point : corner_points) {
@@ -96,14 +94,46 @@ static std::vector<std::pair<box_t<dim>, size_t>> sample_range_queries(vec_of_po
                 // make sure the generated box is within the data range
                 another_corner[d] = std::min(point[d] + step, min_max.second[d]);
             }
-            box_t<dim> box(point, another_corner);
-            range_queries.emplace_back(box, fs.range_query(box).size());
+            boxes.emplace_back(point, another_corner);
         }
     }
     
+    return boxes;
+}
+
+// sample range queries
+// selectivity = range_count(q_box) / N
+template<size_t dim>
+static std::vector<std::pair<box_t<dim>, size_t>> sample_range_queries(vec_of_point_t<dim>& points, size_t s=10) {
+    bench::index::FullScan<dim> fs(points);
+
+    std::vector<std::pair<box_t<dim>, size_t>> range_queries;
+    range_queries.reserve(5 * s);
+    for (auto& box : sample_range_boxes(points, s)) {
+        range_queries.emplace_back(box, fs.range_query(box).size());
+    }
+    
     return range_queries;
 }
 
+// sample a workload of range queries to tune indexes on, held out from the timed range queries:
+// the corners are drawn with another seed and boxes that are also timed are dropped
+template<size_t dim>
+static std::vector<box_t<dim>> sample_tuning_workload(vec_of_point_t<dim>& points, 
+    const std::vector<std::pair<box_t<dim>, size_t>>& range_queries, size_t s=10) {
+    std::vector<box_t<dim>> workload;
+    workload.reserve(5 * s);
+    for (auto& box : sample_range_boxes(points, s, 1)) {
+        bool timed = std::any_of(range_queries.begin(), range_queries.end(), 
+            [&box](const std::pair<box_t<dim>, size_t>& q) { return boost::geometry::equals(q.first, box); });
+        if (!timed) {
+            workload.emplace_back(box);
+        }
+    }
+
+    return workload;
+}
+
 
 template<class Index, size_t Dim>
 static void batch_knn_queries(Index& index, std::map<size_t, vec_of_point_t<Dim>>& knn_queries) {
@@ -120,17 +150,54 @@ static void batch_knn_queries(Index& index, std::map<size_t, vec_of_point_t<Dim>
 }
 
 
+// insert the points one by one
+template<class Index, size_t Dim>
+static void batch_inserts(Index& index, vec_of_point_t<Dim>& points) {
+    for (auto& p : points) {
+        index.insert(p);
+    }
+    std::cout << "Inserts: " << points.size() << " Avg. Time: " << index.get_avg_insert_time() << " [ns]" << std::endl;
+    index.reset_timer();
+}
+
+
+// remove the points one by one, every point must be indexed
 template<class Index, size_t Dim>
-static void batch_range_queries(Index& index, std::vector<std::pair<box_t<Dim>, size_t>> range_queries) {
+static void batch_removes(Index& index, vec_of_point_t<Dim>& points) {
+    size_t missing = 0;
+    for (auto& p : points) {
+        if (!index.remove(p)) {
+            missing++;
+        }
+    }
+    std::cout << "Removes: " << points.size() << " Avg. Time: " << index.get_avg_remove_time() << " [ns]" << std::endl;
+    if (missing > 0) {
+        std::cout << "Missing Points: " << missing << std::endl;
+    }
+    index.reset_timer();
+}
+
+
+// check_results is off for approximate indexes (e.g., ZM returns the points of its quantized grid)
+template<class Index, size_t Dim>
+static void batch_range_queries(Index& index, std::vector<std::pair<box_t<Dim>, size_t>> range_queries, bool check_results = true) {
     // pair (range_cnt, time)
     std::vector<std::pair<size_t, long>> range_time;
     range_time.reserve(range_queries.size());
     
+    // the sampled queries carry their true result counts, so wrong results are reported as well
+    size_t wrong = 0;
     for (auto& box : range_queries) {
-        index.range_query(box.first);
+        auto result_size = index.range_query(box.first).size();
+        if (check_results && result_size != box.second) {
+            wrong++;
+        }
         range_time.emplace_back(box.second, index.get_range_time());
         index.reset_timer();
     }
+    if (wrong > 0) {
+        std::cout << "Wrong Results: " << wrong << std::endl;
+    }
 
     // sort by range_cnt
     std::sort(range_time.begin(), range_time.end(), 
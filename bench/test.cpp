@@ -49,7 +49,7 @@ int main() {
     // std::cout << "range query time " << rt.get_range_time() << std::endl;
     // std::cout << "index size " << rt.index_size() << std::endl;
 
-    // bench::index::MLIndex<4, 64, 10> mli(points);
+    // bench::index::MLIndex<4, 64> mli(points, 10);
     // std::cout << mli.range_query(q).size() << std::endl;
     // std::cout << "build time " << mli.get_build_time() << std::endl;
     // std::cout << "range query time " << mli.get_range_time() << std::endl;
@@ -11,9 +11,13 @@ BaseIndex() {
     point_time = 0;
     range_time = 0;
     knn_time = 0;
+    insert_time = 0;
+    remove_time = 0;
     point_count = 0;
     range_count = 0;
     knn_count = 0;
+    insert_count = 0;
+    remove_count = 0;
 }
 
 // return the index construction time
@@ -36,6 +40,16 @@ inline size_t get_knn_time() {
     return knn_time;
 }
 
+// return the total time of all historically invoked inserts
+inline size_t get_insert_time() {
+    return insert_time;
+}
+
+// return the total time of all historically invoked removes
+inline size_t get_remove_time() {
+    return remove_time;
+}
+
 inline double get_avg_point_time() {
     return (point_time * 1.0) / point_count;
 }
@@ -48,15 +62,27 @@ inline double get_avg_knn_time() {
     return (knn_time * 1.0) / knn_count;
 }
 
+inline double get_avg_insert_time() {
+    return (insert_time * 1.0) / insert_count;
+}
+
+inline double get_avg_remove_time() {
+    return (remove_time * 1.0) / remove_count;
+}
+
 // reset query timers
 // no need to reset build_time
 inline void reset_timer() {
     point_time = 0;
     range_time = 0;
     knn_time = 0;
+    insert_time = 0;
+    remove_time = 0;
     point_count = 0;
     range_count = 0;
     knn_count = 0;
+    insert_count = 0;
+    remove_count = 0;
 }
 
 protected:
@@ -68,10 +94,16 @@ size_t point_time;
 size_t range_time;
 // unit [us]
 size_t knn_time;
+// unit [ns], a single update takes well below a microsecond
+size_t insert_time;
+// unit [ns]
+size_t remove_time;
 
 size_t point_count;
 size_t range_count;
 size_t knn_count;
+size_t insert_count;
+size_t remove_count;
 
 };
 
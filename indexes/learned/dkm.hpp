@@ -9,11 +9,15 @@
 #include <cassert>
 #include <cstddef>
 #include <cstdint>
+#include <cstring>
+#include <limits>
 #include <random>
 #include <tuple>
 #include <type_traits>
 #include <vector>
 
+#include "../../utils/parallel.hpp"
+
 /*
 DKM - A k-means implementation that is generic across variable data dimensions.
 */
@@ -183,6 +187,171 @@ bool deltas_below_limit(const std::vector<T>& deltas, T min_delta) {
 	return true;
 }
 
+/*
+The means in a blocked structure-of-arrays layout: blocks of soa_block<T> means, and within a block all the first
+coordinates, then all the second ones, ... The last block is padded with means at infinity. The distances from a
+point to the means of a block are accumulated in registers by a loop that the compiler vectorizes.
+*/
+#if defined(__AVX512F__)
+constexpr size_t native_vector_bytes = 64;
+#elif defined(__AVX__)
+constexpr size_t native_vector_bytes = 32;
+#else
+constexpr size_t native_vector_bytes = 16;
+#endif
+
+// one block fills a native vector register, wider blocks are split by the compiler into slower code
+template <typename T>
+constexpr size_t soa_block = native_vector_bytes / sizeof(T);
+
+template <typename T, size_t N>
+std::vector<T> transpose_means(const std::vector<std::array<T, N>>& means) {
+	size_t blocks = (means.size() + soa_block<T> - 1) / soa_block<T>;
+	std::vector<T> soa(blocks * N * soa_block<T>, std::numeric_limits<T>::max());
+	for (size_t j = 0; j < means.size(); ++j) {
+		for (size_t d = 0; d < N; ++d) {
+			soa[((j / soa_block<T>) * N + d) * soa_block<T> + (j % soa_block<T>)] = means[j][d];
+		}
+	}
+	return soa;
+}
+
+/*
+Calculate the index of the mean a point is closest to, using the means transposed by transpose_means. Ties are
+broken towards the smallest index like closest_mean.
+*/
+template <typename T, size_t N>
+uint32_t closest_mean_soa(const std::array<T, N>& point, const std::vector<T>& soa) {
+	typedef T vector_t __attribute__((vector_size(soa_block<T> * sizeof(T))));
+
+	// every lane keeps the closest mean among those it has seen, without branches
+	vector_t smallest_distances = {};
+	smallest_distances += std::numeric_limits<T>::max();
+	// block numbers are kept as T so that the selection below is a plain bitwise blend
+	vector_t smallest_blocks = {};
+	size_t blocks = soa.size() / (N * soa_block<T>);
+	for (size_t b = 0; b < blocks; ++b) {
+		vector_t distances = {};
+		for (size_t d = 0; d < N; ++d) {
+			vector_t coords;
+			std::memcpy(&coords, soa.data() + (b * N + d) * soa_block<T>, sizeof(coords));
+			vector_t delta = coords - point[d];
+			distances += delta * delta;
+		}
+		auto closer = distances < smallest_distances;
+		smallest_distances = closer ? distances : smallest_distances;
+		vector_t block = {};
+		block += static_cast<T>(b);
+		smallest_blocks = closer ? block : smallest_blocks;
+	}
+
+	// reduce the lanes, ties are broken towards the smallest index
+	T smallest_distance = smallest_distances[0];
+	uint32_t index = static_cast<uint32_t>(smallest_blocks[0]) * soa_block<T>;
+	for (size_t j = 1; j < soa_block<T>; ++j) {
+		uint32_t lane_index = static_cast<uint32_t>(smallest_blocks[j]) * soa_block<T> + j;
+		if (smallest_distances[j] < smallest_distance
+			|| (smallest_distances[j] == smallest_distance && lane_index < index)) {
+			smallest_distance = smallest_distances[j];
+			index = lane_index;
+		}
+	}
+	return index;
+}
+
+/*
+Parallel version of calculate_clusters using the structure-of-arrays kernel.
+*/
+template <typename T, size_t N>
+void calculate_clusters_parallel(const std::vector<std::array<T, N>>& data,
+	const std::vector<std::array<T, N>>& means,
+	std::vector<uint32_t>& clusters) {
+	auto soa = transpose_means(means);
+	clusters.resize(data.size());
+	bench::common::parallel_for(data.size(), [&](size_t lo, size_t hi) {
+		for (size_t i = lo; i < hi; ++i) {
+			clusters[i] = closest_mean_soa(data[i], soa);
+		}
+	});
+}
+
+/*
+Parallel version of calculate_means. Every thread accumulates the sums of its own chunk, the partial sums are then
+reduced in chunk order.
+*/
+template <typename T, size_t N>
+std::vector<std::array<T, N>> calculate_means_parallel(const std::vector<std::array<T, N>>& data,
+	const std::vector<uint32_t>& clusters,
+	const std::vector<std::array<T, N>>& old_means,
+	uint32_t k) {
+	size_t n = std::min(clusters.size(), data.size());
+	size_t chunks = std::max<size_t>(1, std::min(bench::common::build_threads(), n / (1 << 14)));
+	size_t chunk_size = (n + chunks - 1) / chunks;
+	std::vector<std::vector<std::array<T, N>>> sums(chunks, std::vector<std::array<T, N>>(k));
+	std::vector<std::vector<T>> counts(chunks, std::vector<T>(k, T()));
+
+	bench::common::parallel_tasks(chunks, [&](size_t c) {
+		size_t lo = std::min(n, c * chunk_size), hi = std::min(n, lo + chunk_size);
+		for (size_t i = lo; i < hi; ++i) {
+			auto& mean = sums[c][clusters[i]];
+			counts[c][clusters[i]] += 1;
+			for (size_t j = 0; j < N; ++j) {
+				mean[j] += data[i][j];
+			}
+		}
+	});
+
+	std::vector<std::array<T, N>> means(k);
+	for (size_t i = 0; i < k; ++i) {
+		T count = T();
+		for (size_t c = 0; c < chunks; ++c) {
+			count += counts[c][i];
+			for (size_t j = 0; j < N; ++j) {
+				means[i][j] += sums[c][i][j];
+			}
+		}
+		if (count == 0) {
+			means[i] = old_means[i];
+		} else {
+			for (size_t j = 0; j < N; ++j) {
+				means[i][j] /= count;
+			}
+		}
+	}
+	return means;
+}
+
+/*
+kmeans++ initialization with the same choices as random_plusplus. The distance of each point to its closest mean is
+updated with the newest mean only, in parallel, instead of being recomputed against all the means at every step.
+*/
+template <typename T, size_t N>
+std::vector<std::array<T, N>> random_plusplus_parallel(const std::vector<std::array<T, N>>& data, uint32_t k, uint64_t seed) {
+	assert(k > 0);
+	assert(data.size() > 0);
+	using input_size_t = typename std::array<T, N>::size_type;
+	std::vector<std::array<T, N>> means;
+	std::linear_congruential_engine<uint64_t, 6364136223846793005, 1442695040888963407, UINT64_MAX> rand_engine(seed);
+
+	{
+		std::uniform_int_distribution<input_size_t> uniform_generator(0, data.size() - 1);
+		means.push_back(data[uniform_generator(rand_engine)]);
+	}
+
+	std::vector<T> distances(data.size(), std::numeric_limits<T>::max());
+	for (uint32_t count = 1; count < k; ++count) {
+		const auto& newest = means.back();
+		bench::common::parallel_for(data.size(), [&](size_t lo, size_t hi) {
+			for (size_t i = lo; i < hi; ++i) {
+				distances[i] = std::min(distances[i], distance_squared(data[i], newest));
+			}
+		});
+		std::discrete_distribution<input_size_t> generator(distances.begin(), distances.end());
+		means.push_back(data[generator(rand_engine)]);
+	}
+	return means;
+}
+
 } // namespace details
 
 /*
@@ -296,6 +465,100 @@ std::tuple<std::vector<std::array<T, N>>, std::vector<uint32_t>> kmeans_lloyd(
 	return std::tuple<std::vector<std::array<T, N>>, std::vector<uint32_t>>(means, clusters);
 }
 
+/*
+Multi-threaded version of kmeans_lloyd. The kmeans++ initialization, the assignment step and the update step run on
+the build threads of bench::common, and the assignment step uses a structure-of-arrays nearest mean kernel.
+*/
+template <typename T, size_t N>
+std::tuple<std::vector<std::array<T, N>>, std::vector<uint32_t>> kmeans_lloyd_parallel(
+	const std::vector<std::array<T, N>>& data, const clustering_parameters<T>& parameters) {
+	static_assert(std::is_arithmetic<T>::value && std::is_signed<T>::value,
+		"kmeans_lloyd_parallel requires the template parameter T to be a signed arithmetic type (e.g. float, double, int)");
+	assert(parameters.get_k() > 0); // k must be greater than zero
+	assert(data.size() >= parameters.get_k()); // there must be at least k data points
+	std::random_device rand_device;
+	uint64_t seed = parameters.has_random_seed() ? parameters.get_random_seed() : rand_device();
+	std::vector<std::array<T, N>> means = details::random_plusplus_parallel(data, parameters.get_k(), seed);
+
+	std::vector<std::array<T, N>> old_means;
+	std::vector<std::array<T, N>> old_old_means;
+	std::vector<uint32_t> clusters;
+	uint64_t count = 0;
+	do {
+		details::calculate_clusters_parallel(data, means, clusters);
+		old_old_means = old_means;
+		old_means = means;
+		means = details::calculate_means_parallel(data, clusters, old_means, parameters.get_k());
+		++count;
+	} while (means != old_means && means != old_old_means
+		&& !(parameters.has_max_iteration() && count == parameters.get_max_iteration())
+		&& !(parameters.has_min_delta() && details::deltas_below_limit(details::deltas(old_means, means), parameters.get_min_delta())));
+
+	return std::tuple<std::vector<std::array<T, N>>, std::vector<uint32_t>>(means, clusters);
+}
+
+/*
+Mini-batch k-means (Sculley, "Web-scale k-means clustering", WWW 2010).
+
+The means are initialized with kmeans++ on a uniform sample of the data, then every iteration assigns a random batch
+of `batch_size` points to their closest means and moves each mean towards its points with a per-mean learning rate
+of 1 / (number of points assigned to it so far). The maximum iteration count of `parameters` is the number of batches
+(100 if unset). A final full assignment pass returns the cluster of every point, as kmeans_lloyd does.
+*/
+template <typename T, size_t N>
+std::tuple<std::vector<std::array<T, N>>, std::vector<uint32_t>> kmeans_minibatch(
+	const std::vector<std::array<T, N>>& data, const clustering_parameters<T>& parameters, size_t batch_size) {
+	static_assert(std::is_arithmetic<T>::value && std::is_signed<T>::value,
+		"kmeans_minibatch requires the template parameter T to be a signed arithmetic type (e.g. float, double, int)");
+	assert(parameters.get_k() > 0); // k must be greater than zero
+	assert(data.size() >= parameters.get_k()); // there must be at least k data points
+	assert(batch_size > 0);
+	using input_size_t = typename std::array<T, N>::size_type;
+	std::random_device rand_device;
+	uint64_t seed = parameters.has_random_seed() ? parameters.get_random_seed() : rand_device();
+	std::linear_congruential_engine<uint64_t, 6364136223846793005, 1442695040888963407, UINT64_MAX> rand_engine(seed);
+	std::uniform_int_distribution<input_size_t> uniform_generator(0, data.size() - 1);
+	const uint32_t k = parameters.get_k();
+
+	// kmeans++ on a sample of the data
+	size_t sample_size = std::min<size_t>(data.size(), std::max<size_t>(batch_size, size_t(k) * 64));
+	std::vector<std::array<T, N>> sample;
+	sample.reserve(sample_size);
+	for (size_t i = 0; i < sample_size; ++i) {
+		sample.push_back(data[uniform_generator(rand_engine)]);
+	}
+	std::vector<std::array<T, N>> means = details::random_plusplus_parallel(sample, k, seed);
+
+	std::vector<T> counts(k, T());
+	std::vector<std::array<T, N>> batch(batch_size);
+	std::vector<uint32_t> assignments;
+	uint64_t iterations = parameters.has_max_iteration() ? parameters.get_max_iteration() : 100;
+	for (uint64_t count = 0; count < iterations; ++count) {
+		for (auto& point : batch) {
+			point = data[uniform_generator(rand_engine)];
+		}
+		details::calculate_clusters_parallel(batch, means, assignments);
+
+		auto old_means = means;
+		for (size_t i = 0; i < batch.size(); ++i) {
+			auto& mean = means[assignments[i]];
+			counts[assignments[i]] += 1;
+			T eta = T(1) / counts[assignments[i]];
+			for (size_t j = 0; j < N; ++j) {
+				mean[j] += eta * (batch[i][j] - mean[j]);
+			}
+		}
+
+		if (parameters.has_min_delta() && details::deltas_below_limit(details::deltas(old_means, means), parameters.get_min_delta())) {
+			break;
+		}
+	}
+
+	std::vector<uint32_t> clusters;
+	details::calculate_clusters_parallel(data, means, clusters);
+	return std::tuple<std::vector<std::array<T, N>>, std::vector<uint32_t>>(means, clusters);
+}
+
 /*
 This overload exists to support legacy code which uses this signature of the kmeans_lloyd function.
 Any code still using this signature should move to the version of this function that uses a
@@ -4,6 +4,8 @@
 #include <array>
 #include <cstddef>
 #include <iostream>
+#include <limits>
+#include <queue>
 #include <tuple>
 #include <variant>
 #include <boost/multi_array.hpp>
@@ -14,13 +16,16 @@
 #include "../base_index.hpp"
 #include "../../utils/type.hpp"
 #include "../../utils/common.hpp"
+#include "../../utils/parallel.hpp"
 #include "../pgm/pgm_index.hpp"
 #include "../pgm/pgm_index_variants.hpp"
 
 
 namespace bench { namespace index {
 
-// the sort dimension is always the last dimension
+// the grid has K columns on every dimension but the sort dimension, which is SortDim by default
+// given a sample query workload, the sort dimension and the per-dimension column numbers are learned instead,
+// the workload should be held out from the queries that are timed
 template<size_t Dim, size_t K, size_t Eps=64, size_t SortDim=Dim-1>
 class Flood : public BaseIndex {
 
@@ -31,79 +36,86 @@ using Box = box_t<Dim>;
 
 using Index = pgm::PGMIndex<double, Eps>;
 
-public:
+// the layout is tuned on a sample of the points
+static constexpr size_t tuning_sample_size = 1 << 15;
+// cells hold at least this many points on average
+static constexpr size_t min_cell_size = 8;
 
-class Bucket {
-    public:
-    Points _local_points;
-    // eps for each bucket is fixed to 16 based on a micro benchmark
-    pgm::PGMIndex<double, 16>* _local_pgm;
+public:
 
-    Bucket() : _local_pgm(nullptr) {} ;
+// the grid layout: the sort dimension and the number of columns on each dimension
+// the sort dimension always has a single column
+struct Layout {
+    size_t sort_dim;
+    std::array<size_t, Dim> columns;
 
-    ~Bucket() {
-        delete this->_local_pgm;
-    }
-
-    inline void insert(Point& p) {
-        this->_local_points.emplace_back(p);
-    }
-
-    inline void build() {
-        if (_local_points.size() == 0) {
-            return;
-        }
-        // note points are already sorted by SortDim
-        std::vector<double> idx_data;
-        idx_data.reserve(_local_points.size());
-        for (const auto& p : _local_points) {
-            idx_data.emplace_back(std::get<SortDim>(p));
+    inline size_t cells() const {
+        size_t n = 1;
+        for (auto c : columns) {
+            n *= c;
         }
-
-        _local_pgm = new pgm::PGMIndex<double, 16>(idx_data);
+        return n;
     }
+};
 
-    inline void search(Points& result, Box& box) {
-        if (_local_pgm == nullptr) {
-            return;
-        }
-        
-        auto min_key = std::get<SortDim>(box.min_corner());
-        auto max_key = std::get<SortDim>(box.max_corner());
-        auto range_lo = this->_local_pgm->search(min_key);
-        auto range_hi = this->_local_pgm->search(max_key);
-
-        for (size_t i=range_lo.lo; i<range_hi.hi; ++i) {
-            if (bench::common::is_in_box(this->_local_points[i], box)) {
-                result.emplace_back(this->_local_points[i]);
-            }
-        }
-    }
+// a linear segment of a cell model, positions are relative to the first point of the cell
+struct CellSegment {
+    double key;
+    double slope;
+    int64_t intercept;
 };
 
-Flood(Points& points) : _data(points), bucket_size((points.size() + K - 1)/K) {
-    std::cout << "Construct Flood " << "K=" << K << " Epsilon=" << Eps << " SortDim=" << SortDim << std::endl;
+Flood(Points& points, const std::vector<Box>& workload={}) : _data(points) {
+    std::cout << "Construct Flood " << "K=" << K << " Epsilon=" << Eps << " SortDim=" << SortDim
+              << (workload.empty() ? "" : " Layout=learned") << std::endl;
 
     auto start = std::chrono::steady_clock::now();
 
+    if (workload.empty()) {
+        layout.sort_dim = SortDim;
+        std::fill(layout.columns.begin(), layout.columns.end(), K);
+        layout.columns[SortDim] = 1;
+    } else {
+        layout = optimize_layout(points, workload);
+    }
+    const size_t sort_dim = layout.sort_dim;
+
+    std::cout << "Layout: SortDim=" << sort_dim << " Columns=";
+    for (size_t i=0; i<Dim; ++i) {
+        std::cout << (i ? "x" : "") << layout.columns[i];
+    }
+    std::cout << std::endl;
+
     // dimension offsets when computing bucket ID
-    for (size_t i=0; i<Dim-1; ++i) {
-        this->dim_offset[i] = bench::common::ipow(K, i);
+    size_t offset = 1;
+    for (size_t i=0; i<Dim; ++i) {
+        this->dim_offset[i] = offset;
+        offset *= layout.columns[i];
     }
 
-    // sort points by SortDim
-    std::sort(_data.begin(), _data.end(), [](auto& p1, auto& p2) {
-        return std::get<SortDim>(p1) < std::get<SortDim>(p2);
-    });
+    // sort points by the sort dimension
+    {
+        auto order = bench::common::sort_by_key<double>(_data, [sort_dim](Point& p) { return p[sort_dim]; });
+        Points sorted_points;
+        bench::common::gather(_data, order, sorted_points);
+        _data.swap(sorted_points);
+    }
 
     // boundaries of each dimension
     std::fill(mins.begin(), mins.end(), std::numeric_limits<double>::max());
     std::fill(maxs.begin(), maxs.end(), std::numeric_limits<double>::min());
-
-    // train model on dimension 1 -- Dim-1
-    std::vector<double> idx_data;
-    idx_data.reserve(points.size());
-    for (size_t i=0; i<Dim-1; ++i) {
+    std::fill(indexes.begin(), indexes.end(), nullptr);
+
+    // train model on every dimension but the sort dimension
+    // with enough threads the per-dimension models are fitted concurrently, each segmented serially,
+    // otherwise they are fitted one by one, each with a parallel sort and segmentation
+    const bool concurrent_dims = (Dim - 1 >= bench::common::build_threads());
+    auto fit_dim = [&](size_t i) {
+        if (i == sort_dim) {
+            return;
+        }
+        std::vector<double> idx_data;
+        idx_data.reserve(_data.size());
         for (const auto& p : _data) {
             mins[i] = std::min(p[i], mins[i]);
             maxs[i] = std::max(p[i], maxs[i]);
@@ -111,21 +123,84 @@ Flood(Points& points) : _data(points), bucket_size((points.size() + K - 1)/K) {
             idx_data.emplace_back(p[i]);
         }
 
-        std::sort(idx_data.begin(), idx_data.end());
+        if (concurrent_dims) {
+            std::sort(idx_data.begin(), idx_data.end());
+        } else {
+            bench::common::parallel_sort(idx_data);
+        }
         this->indexes[i] = new Index(idx_data);
+    };
+
+    if (concurrent_dims) {
+        bench::common::parallel_tasks(Dim, fit_dim);
+    } else {
+        for (size_t i=0; i<Dim; ++i) {
+            fit_dim(i);
+        }
+    }
+
+
+    // group the points by cell with a counting sort, which keeps them sorted by the sort dimension within each cell
+    const size_t n = _data.size();
+    const size_t cells = layout.cells();
+    std::vector<size_t> cell_of(n);
+    bench::common::parallel_for(n, [&](size_t lo, size_t hi) {
+        for (size_t i=lo; i<hi; ++i) {
+            cell_of[i] = compute_id(_data[i]);
+        }
+    });
 
-        idx_data.clear();
+    this->cell_begin.assign(cells + 1, 0);
+    for (auto c : cell_of) {
+        cell_begin[c + 1]++;
+    }
+    for (size_t c=0; c<cells; ++c) {
+        cell_begin[c + 1] += cell_begin[c];
     }
 
+    {
+        Points cell_points(n);
+        std::vector<size_t> next(cell_begin.begin(), cell_begin.end() - 1);
+        for (size_t i=0; i<n; ++i) {
+            cell_points[next[cell_of[i]]++] = _data[i];
+        }
+        _data.swap(cell_points);
+    }
 
-    // note data are sorted by SortDim
-    for (auto& p : _data) {
-        buckets[compute_id(p)].insert(p);
+    this->sort_keys.resize(n);
+    for (size_t i=0; i<n; ++i) {
+        sort_keys[i] = _data[i][sort_dim];
+    }
+
+    // extent of the points of each column on each dimension
+    for (size_t i=0; i<Dim; ++i) {
+        col_mins[i].assign(layout.columns[i], std::numeric_limits<double>::infinity());
+        col_maxs[i].assign(layout.columns[i], -std::numeric_limits<double>::infinity());
+    }
+    for (size_t c=0; c<cells; ++c) {
+        for (size_t i=0; i<Dim; ++i) {
+            auto idx = (c / dim_offset[i]) % layout.columns[i];
+            for (size_t j=cell_begin[c]; j<cell_begin[c + 1]; ++j) {
+                col_mins[i][idx] = std::min(col_mins[i][idx], _data[j][i]);
+                col_maxs[i][idx] = std::max(col_maxs[i][idx], _data[j][i]);
+            }
+        }
     }
 
-    for (auto& b : buckets) {
-        b.build();
+    // column boundaries for knn queries: the columns of a dimension are ordered by value, so the running maximum
+    // of their extents tiles the dimension, and the first and the last columns extend to infinity
+    for (size_t i=0; i<Dim; ++i) {
+        const size_t columns = layout.columns[i];
+        col_bounds[i].assign(columns + 1, -std::numeric_limits<double>::infinity());
+        for (size_t j=0; j+1<columns; ++j) {
+            col_bounds[i][j + 1] = std::max(col_bounds[i][j], col_maxs[i][j]);
+        }
+        col_bounds[i][columns] = std::numeric_limits<double>::infinity();
     }
+    this->cell_search = bench::common::GridBestFirst<Dim>(layout.columns);
+
+    // cell models are independent and fitted concurrently
+    fit_cells(sort_keys, cell_begin, seg_begin, segments);
 
     auto end = std::chrono::steady_clock::now();
     build_time = std::chrono::duration_cast<std::chrono::milliseconds>(end - start).count();
@@ -136,17 +211,13 @@ Flood(Points& points) : _data(points), bucket_size((points.size() + K - 1)/K) {
 Points range_query(Box& box) {
     auto start = std::chrono::steady_clock::now();
 
-    // find all intersected cells
-    std::vector<std::pair<size_t, size_t>> ranges;
-    find_intersect_ranges(ranges, box);
-    
-    // search each cell using local models
+    // search each intersected cell using its local model
+    // the sort dimension is never cut since the cell models trim the scan to the query range on it
     Points result;
-    for (auto& range : ranges) {
-        for (auto idx=range.first; idx<=range.second; ++idx) {
-            this->buckets[idx].search(result, box);
-        }
-    }
+    bench::common::grid_range_scan<Dim>(box, [this](Point& p, size_t d) { return get_dim_idx(p, d); }, col_mins, col_maxs, dim_offset, result,
+        [this](size_t first, size_t last) { return cell_begin[last + 1] - cell_begin[first]; },
+        [&](size_t idx, uint32_t mask) { search_cell(result, box, idx, mask); },
+        layout.sort_dim);
 
     auto end = std::chrono::steady_clock::now();
     range_time += std::chrono::duration_cast<std::chrono::microseconds>(end - start).count();
@@ -155,6 +226,47 @@ Points range_query(Box& box) {
     return result;
 }
 
+// best-first knn search over grid cells
+// cells are visited in increasing distance from the query, within a cell the scan starts at the query's position
+// on the sort dimension and moves outward until the gap on the sort dimension exceeds the k-th point found
+Points knn_query(Point& point, size_t k) {
+    auto start = std::chrono::steady_clock::now();
+
+    // the k closest points found so far, a max-heap on squared distance
+    std::priority_queue<std::pair<double, size_t>> knn;
+
+    std::array<size_t, Dim> start_cell;
+    for (size_t i=0; i<Dim; ++i) {
+        start_cell[i] = (i == layout.sort_dim) ? 0 : get_dim_idx(point, i);
+    }
+
+    auto bounds = [this](size_t d, size_t idx) {
+        return std::make_pair(col_bounds[d][idx], col_bounds[d][idx + 1]);
+    };
+
+    if (k > 0) {
+        this->cell_search.search(point, start_cell, bounds, [&](size_t cell_id, auto&, double min_dist_square) {
+            if (knn.size() == k && min_dist_square >= knn.top().first) {
+                return false;
+            }
+            scan_cell(knn, point, k, cell_id);
+            return true;
+        });
+    }
+
+    auto end = std::chrono::steady_clock::now();
+    knn_time += std::chrono::duration_cast<std::chrono::microseconds>(end - start).count();
+    knn_count ++;
+
+    Points knn_result(knn.size());
+    for (size_t i=knn.size(); i-- > 0; ) {
+        knn_result[i] = this->_data[knn.top().second];
+        knn.pop();
+    }
+
+    return knn_result;
+}
+
 inline size_t count() {
     return _data.size();
 }
@@ -162,81 +274,215 @@ inline size_t count() {
 inline size_t index_size() {
     // size of dimension-level learned index
     size_t cdf_size = 0;
-    for (size_t i=0; i<Dim-1; ++i) {
-        cdf_size += this->indexes[i]->size_in_bytes();
+    for (size_t i=0; i<Dim; ++i) {
+        if (this->indexes[i] != nullptr) {
+            cdf_size += this->indexes[i]->size_in_bytes();
+        }
     }
 
-    // size of models within each bucket
-    size_t b_size = 0;
-    for (size_t i=0; i<buckets.size(); ++i) {
-        if (buckets[i]._local_pgm != nullptr) {
-            b_size += buckets[i]._local_pgm->size_in_bytes();
-        }
+    // size of the cell models, the cell offset tables and the sort keys
+    size_t cell_size = segments.size() * sizeof(CellSegment) + (cell_begin.size() + seg_begin.size()) * sizeof(size_t)
+        + sort_keys.size() * sizeof(double);
+    for (size_t i=0; i<Dim; ++i) {
+        cell_size += (col_mins[i].size() + col_maxs[i].size() + col_bounds[i].size()) * sizeof(double);
     }
+    cell_size += cell_search.size_in_bytes();
 
-    return cdf_size + b_size + count() * sizeof(size_t);
+    return cdf_size + cell_size + count() * sizeof(size_t);
+}
+
+inline const Layout& get_layout() {
+    return this->layout;
 }
 
 
 ~Flood() {
-    for (size_t i=0; i<Dim-1; ++i) {
+    for (size_t i=0; i<Dim; ++i) {
         delete this->indexes[i];
     }
 }
 
 
 private:
+// eps for each cell model is fixed to 16 based on a micro benchmark
+static constexpr size_t CellEps = 16;
+
+// points ordered by (cell, sort key), the points of cell c are in [cell_begin[c], cell_begin[c+1])
 Points& _data;
-std::array<Index*, Dim-1> indexes;
-std::array<Bucket, bench::common::ipow(K, Dim-1)> buckets;
-std::array<size_t, Dim-1> dim_offset;
+Layout layout;
+// the sort dimension has no model
+std::array<Index*, Dim> indexes;
+std::array<size_t, Dim> dim_offset;
+
+std::vector<size_t> cell_begin;
+// extent of the points of each column on each dimension
+std::array<std::vector<double>, Dim> col_mins;
+std::array<std::vector<double>, Dim> col_maxs;
+// boundaries of the columns on each dimension, column j spans [col_bounds[d][j], col_bounds[d][j+1]]
+std::array<std::vector<double>, Dim> col_bounds;
+// best-first traversal of grid cells for knn queries
+bench::common::GridBestFirst<Dim> cell_search;
+// the keys of the points on the sort dimension, for the last-mile searches
+std::vector<double> sort_keys;
+// the models of all cells in one array, the segments of cell c are in [seg_begin[c], seg_begin[c+1])
+std::vector<size_t> seg_begin;
+std::vector<CellSegment> segments;
+
+std::array<double, Dim> mins;
+std::array<double, Dim> maxs;
+
+// search a cell whose points are refined on the dimensions in mask
+// the model lookups are skipped when the query covers the keys of the cell on the sort dimension,
+// and the points are copied as a whole when no dimension cuts the cell
+inline void search_cell(Points& result, Box& box, size_t cell, uint32_t mask) {
+    const size_t lo = cell_begin[cell];
+    const size_t n = cell_begin[cell + 1] - lo;
+    if (n == 0) {
+        return;
+    }
 
-std::array<double, Dim-1> mins;
-std::array<double, Dim-1> maxs;
+    const double* keys = sort_keys.data() + lo;
+    const double min_key = box.min_corner()[layout.sort_dim];
+    const double max_key = box.max_corner()[layout.sort_dim];
+    size_t first = 0, last = n;
+    if (keys[0] < min_key || keys[n - 1] > max_key) {
+        const CellSegment* segs = segments.data() + seg_begin[cell];
+        const size_t n_segs = seg_begin[cell + 1] - seg_begin[cell];
+        first = cell_lower_bound(keys, n, segs, n_segs, min_key);
+        last = cell_upper_bound(keys, n, segs, n_segs, max_key);
+    }
 
-const size_t bucket_size;
+    bench::common::emit_cell_points(result, _data.begin() + lo + first, _data.begin() + lo + last, box, mask);
+}
 
-inline void find_intersect_ranges(std::vector<std::pair<size_t, size_t>>& ranges, Box& qbox) {
-    if (Dim == 2) {
-        ranges.emplace_back(get_dim_idx(qbox.min_corner(), 0), get_dim_idx(qbox.max_corner(), 0));
-    } else {
-        // search range on the 1-st dimension
-        ranges.emplace_back(get_dim_idx(qbox.min_corner(), 0), get_dim_idx(qbox.max_corner(), 0));
-        
-        // find all intersect ranges
-        for (size_t i=1; i<Dim-1; ++i) {
-            auto start_idx = get_dim_idx(qbox.min_corner(), i);
-            auto end_idx = get_dim_idx(qbox.max_corner(), i);
-
-            std::vector<std::pair<size_t, size_t>> temp_ranges;
-            for (auto idx=start_idx; idx<=end_idx; ++idx) {
-                for (size_t j=0; j<ranges.size(); ++j) {
-                    temp_ranges.emplace_back(ranges[j].first + idx*dim_offset[i], ranges[j].second + idx*dim_offset[i]);
-                }
-            }
+// update the knn heap with the points of a cell
+// the cell model locates the query on the sort dimension, and the scan grows a window around it
+// towards the closer side until both sides are farther on the sort dimension alone than the k-th point
+inline void scan_cell(std::priority_queue<std::pair<double, size_t>>& knn, Point& q, size_t k, size_t cell) {
+    const size_t lo = cell_begin[cell];
+    const size_t n = cell_begin[cell + 1] - lo;
+    if (n == 0) {
+        return;
+    }
+
+    const double* keys = sort_keys.data() + lo;
+    const double key = q[layout.sort_dim];
+    const CellSegment* segs = segments.data() + seg_begin[cell];
+    const size_t n_segs = seg_begin[cell + 1] - seg_begin[cell];
+    size_t left = cell_lower_bound(keys, n, segs, n_segs, key);
+    size_t right = left;
+
+    // the window [left, right) has been scanned
+    while (left > 0 || right < n) {
+        double gap_left = (left > 0) ? key - keys[left - 1] : std::numeric_limits<double>::infinity();
+        double gap_right = (right < n) ? keys[right] - key : std::numeric_limits<double>::infinity();
+        double gap = std::min(gap_left, gap_right);
+        if (knn.size() == k && gap * gap >= knn.top().first) {
+            break;
+        }
+
+        size_t i = lo + ((gap_left <= gap_right) ? --left : right++);
+        double d = bench::common::eu_dist_square(this->_data[i], q);
+        if (knn.size() < k) {
+            knn.emplace(d, i);
+        } else if (d < knn.top().first) {
+            knn.pop();
+            knn.emplace(d, i);
+        }
+    }
+}
 
-            // update the range vector
-            ranges = temp_ranges;
+// fit the model of every cell on its sorted keys and flatten the segments into one array
+// cells are fitted concurrently in chunks, whose segments are then concatenated in cell order
+static void fit_cells(const std::vector<double>& keys, const std::vector<size_t>& cell_begin,
+                      std::vector<size_t>& seg_begin, std::vector<CellSegment>& segments) {
+    const size_t cells = cell_begin.size() - 1;
+    const size_t chunks = std::max<size_t>(1, std::min(cells, bench::common::build_threads() * 8));
+    const size_t chunk_size = (cells + chunks - 1) / chunks;
+
+    std::vector<std::vector<CellSegment>> chunk_segments(chunks);
+    seg_begin.assign(cells + 1, 0);
+    bench::common::parallel_tasks(chunks, [&](size_t t) {
+        for (size_t c=t*chunk_size; c<std::min(cells, (t+1)*chunk_size); ++c) {
+            const size_t lo = cell_begin[c];
+            const size_t n = cell_begin[c + 1] - lo;
+            // duplicate keys are skipped, a run of equal keys is mapped to its first position
+            auto in_fun = [&](size_t i) { return std::pair<double, size_t>(keys[lo + i], i); };
+            auto out_fun = [&](const auto& cs) {
+                auto [slope, intercept] = cs.get_floating_point_segment(cs.get_first_x());
+                chunk_segments[t].push_back({cs.get_first_x(), static_cast<double>(slope), static_cast<int64_t>(intercept)});
+            };
+            seg_begin[c + 1] = pgm::internal::make_segmentation(n, CellEps, in_fun, out_fun);
         }
+    });
+
+    for (size_t c=0; c<cells; ++c) {
+        seg_begin[c + 1] += seg_begin[c];
+    }
+    segments.clear();
+    segments.reserve(seg_begin[cells]);
+    for (auto& v : chunk_segments) {
+        segments.insert(segments.end(), v.begin(), v.end());
     }
 }
 
-// locate the bucket on d-th dimension using binary search
+// the approximate position of key in a cell of n keys
+static inline size_t cell_predict(const CellSegment* segs, size_t n_segs, size_t n, double key) {
+    auto it = pgm::branchless_upper_bound(segs, segs + n_segs, key,
+        [](double k, const CellSegment& seg) { return k < seg.key; });
+    if (it == segs) {
+        return 0;
+    }
+    --it;
+    int64_t pos = static_cast<int64_t>(it->slope * (key - it->key)) + it->intercept;
+    int64_t cap = (it + 1 < segs + n_segs) ? (it + 1)->intercept : static_cast<int64_t>(n);
+    return static_cast<size_t>(std::clamp<int64_t>(pos, 0, cap));
+}
+
+// the error bound only holds for the indexed keys, so the result is checked against the window
+// and the whole cell is searched when the window does not contain it, e.g., at the end of a run of duplicates
+static inline size_t cell_lower_bound(const double* keys, size_t n, const CellSegment* segs, size_t n_segs, double key) {
+    size_t pos = cell_predict(segs, n_segs, n, key);
+    size_t lo = (pos > CellEps + 1) ? pos - CellEps - 1 : 0;
+    size_t hi = std::min(n, pos + CellEps + 2);
+    if ((lo > 0 && keys[lo - 1] >= key) || (hi < n && keys[hi] < key)) {
+        lo = 0;
+        hi = n;
+    }
+    return pgm::branchless_lower_bound(keys + lo, keys + hi, key) - keys;
+}
+
+static inline size_t cell_upper_bound(const double* keys, size_t n, const CellSegment* segs, size_t n_segs, double key) {
+    size_t pos = cell_predict(segs, n_segs, n, key);
+    size_t lo = (pos > CellEps + 1) ? pos - CellEps - 1 : 0;
+    size_t hi = std::min(n, pos + CellEps + 2);
+    if ((lo > 0 && keys[lo - 1] > key) || (hi < n && keys[hi] <= key)) {
+        lo = 0;
+        hi = n;
+    }
+    return pgm::branchless_upper_bound(keys + lo, keys + hi, key) - keys;
+}
+
+// locate the bucket on d-th dimension using the learned CDF
 inline size_t get_dim_idx(Point& p, size_t d) {
+    const size_t columns = layout.columns[d];
     if (p[d] <= this->mins[d]) {
         return 0;
     }
     if (p[d] >= this->maxs[d]) {
-        return K-1;
+        return columns-1;
     }
-    auto approx_pos = this->indexes[d]->search(p[d]).pos / this->bucket_size;
-    return std::min(approx_pos, K-1);
+    auto approx_pos = this->indexes[d]->search(p[d]).pos * columns / _data.size();
+    return std::min(approx_pos, columns-1);
 }
 
 inline size_t compute_id(Point& p) {
     size_t id = 0;
 
-    for (size_t i=0; i<Dim-1; ++i) {
+    for (size_t i=0; i<Dim; ++i) {
+        if (i == layout.sort_dim) {
+            continue;
+        }
         auto current_idx = get_dim_idx(p, i);
         id += current_idx * dim_offset[i];
     }
@@ -245,6 +491,212 @@ inline size_t compute_id(Point& p) {
 }
 
 
+// layout optimization
+// the cost of a range query is modeled as w_cell * (cells visited) + w_scan * (points scanned),
+// where the weights are calibrated on the data (w_cell for every sort dimension, as the cell models
+// differ by the distribution of the sort dimension), cells and scanned points are counted on a sample
+// for every sort dimension, the column numbers are found by a coordinate descent that doubles or halves
+// the columns of one dimension at a time, starting from K columns on every dimension
+
+// the sample and the workload as ranks in the sample, so that the columns of any layout are computed directly
+struct TuningSample {
+    Points points;
+    // ranks[d][i] is the rank of the i-th sampled point on dimension d
+    std::array<std::vector<size_t>, Dim> ranks;
+    // rank of the lower and upper corners of each query on each dimension
+    std::vector<std::array<size_t, Dim>> lo_ranks, hi_ranks;
+    // for each sort dimension and query, the sampled points within the query range on the sort dimension
+    std::array<std::vector<std::vector<uint32_t>>, Dim> candidates;
+    // weights of the cost model in nanoseconds, w_cell[d] with d as the sort dimension
+    std::array<double, Dim> w_cell;
+    double w_scan;
+    double scale;
+};
+
+inline Layout optimize_layout(Points& points, const std::vector<Box>& workload) {
+    TuningSample ts;
+    ts.points = sample_points(points);
+    const size_t s = ts.points.size();
+    ts.scale = static_cast<double>(points.size()) / s;
+
+    ts.lo_ranks.resize(workload.size());
+    ts.hi_ranks.resize(workload.size());
+    for (size_t d=0; d<Dim; ++d) {
+        std::vector<std::pair<double, uint32_t>> column(s);
+        for (size_t i=0; i<s; ++i) {
+            column[i] = std::make_pair(ts.points[i][d], static_cast<uint32_t>(i));
+        }
+        std::sort(column.begin(), column.end());
+        ts.ranks[d].resize(s);
+        std::vector<double> keys(s);
+        for (size_t r=0; r<s; ++r) {
+            ts.ranks[d][column[r].second] = r;
+            keys[r] = column[r].first;
+        }
+
+        ts.candidates[d].resize(workload.size());
+        for (size_t q=0; q<workload.size(); ++q) {
+            double lo = workload[q].min_corner()[d], hi = workload[q].max_corner()[d];
+            auto first = std::lower_bound(keys.begin(), keys.end(), lo);
+            auto last = std::upper_bound(first, keys.end(), hi);
+            ts.lo_ranks[q][d] = first - keys.begin();
+            ts.hi_ranks[q][d] = std::lower_bound(keys.begin(), keys.end(), hi) - keys.begin();
+            for (auto it=first; it!=last; ++it) {
+                ts.candidates[d][q].emplace_back(column[it - keys.begin()].second);
+            }
+        }
+    }
+
+    calibrate(ts, workload);
+
+    const size_t max_cells = std::max<size_t>(1, points.size() / min_cell_size);
+    Layout best;
+    double best_cost = std::numeric_limits<double>::max();
+    for (size_t sort_dim=0; sort_dim<Dim; ++sort_dim) {
+        Layout current;
+        current.sort_dim = sort_dim;
+        std::fill(current.columns.begin(), current.columns.end(), K);
+        current.columns[sort_dim] = 1;
+        while (current.cells() > max_cells) {
+            auto widest = std::max_element(current.columns.begin(), current.columns.end());
+            *widest = std::max<size_t>(1, *widest / 2);
+        }
+        double current_cost = layout_cost(ts, current);
+
+        bool improved = true;
+        while (improved) {
+            improved = false;
+            for (size_t d=0; d<Dim; ++d) {
+                if (d == sort_dim) {
+                    continue;
+                }
+                for (auto columns : {current.columns[d] * 2, current.columns[d] / 2}) {
+                    if (columns == 0 || columns > s) {
+                        continue;
+                    }
+                    Layout next = current;
+                    next.columns[d] = columns;
+                    if (next.cells() > max_cells) {
+                        continue;
+                    }
+                    double cost = layout_cost(ts, next);
+                    if (cost < current_cost) {
+                        current = next;
+                        current_cost = cost;
+                        improved = true;
+                    }
+                }
+            }
+        }
+
+        if (current_cost < best_cost) {
+            best = current;
+            best_cost = current_cost;
+        }
+    }
+
+    std::cout << "Expected Query Time: " << static_cast<size_t>(best_cost) << " [ns]" << std::endl;
+    return best;
+}
+
+// the average modeled query time of a layout over the workload
+inline double layout_cost(TuningSample& ts, const Layout& l) {
+    const size_t s = ts.points.size();
+    auto column_of = [s](size_t rank, size_t columns) { return std::min(rank * columns / s, columns - 1); };
+
+    const auto& candidates = ts.candidates[l.sort_dim];
+    double cells = 0.0, scanned = 0.0;
+    for (size_t q=0; q<candidates.size(); ++q) {
+        std::array<size_t, Dim> lo_col, hi_col;
+        double visited = 1.0;
+        for (size_t d=0; d<Dim; ++d) {
+            lo_col[d] = column_of(ts.lo_ranks[q][d], l.columns[d]);
+            hi_col[d] = column_of(ts.hi_ranks[q][d], l.columns[d]);
+            visited *= (hi_col[d] - lo_col[d] + 1);
+        }
+        cells += visited;
+
+        // points in the visited cells within the query range on the sort dimension
+        size_t hits = 0;
+        for (auto i : candidates[q]) {
+            bool in_cells = true;
+            for (size_t d=0; d<Dim; ++d) {
+                auto c = column_of(ts.ranks[d][i], l.columns[d]);
+                in_cells &= (c >= lo_col[d]) & (c <= hi_col[d]);
+            }
+            hits += in_cells;
+        }
+        scanned += hits * ts.scale;
+    }
+
+    return (ts.w_cell[l.sort_dim] * cells + ts.w_scan * scanned) / candidates.size();
+}
+
+// measure the weights of the cost model: the time to look up a cell with its model on every sort dimension,
+// and the time to scan and refine a point
+inline void calibrate(TuningSample& ts, const std::vector<Box>& workload) {
+    const size_t s = ts.points.size();
+    const size_t reps = 1 << 16;
+
+    size_t positions = 0;
+    for (size_t sort_dim=0; sort_dim<Dim; ++sort_dim) {
+        // a single cell holding the sample
+        std::vector<double> keys(s);
+        for (size_t i=0; i<s; ++i) {
+            keys[i] = ts.points[i][sort_dim];
+        }
+        std::sort(keys.begin(), keys.end());
+        std::vector<size_t> begins = {0, s}, seg_begins;
+        std::vector<CellSegment> segs;
+        fit_cells(keys, begins, seg_begins, segs);
+
+        // lookups of empty ranges, i.e., no point is scanned
+        auto start = std::chrono::steady_clock::now();
+        for (size_t i=0; i<reps; ++i) {
+            double key = workload[i % workload.size()].min_corner()[sort_dim];
+            positions += cell_lower_bound(keys.data(), s, segs.data(), segs.size(), key);
+            positions += cell_upper_bound(keys.data(), s, segs.data(), segs.size(), key);
+        }
+        auto end = std::chrono::steady_clock::now();
+        ts.w_cell[sort_dim] = std::max(1.0, std::chrono::duration<double, std::nano>(end - start).count() / reps);
+    }
+
+    // every query of the workload refines points, so that w_scan does not depend on the selectivity of a few queries
+    size_t hits = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i=0, p=0; i<reps; ++i, p=(p+1==s) ? 0 : p+1) {
+        Box& box = const_cast<Box&>(workload[i % workload.size()]);
+        hits += bench::common::is_in_box(ts.points[p], box);
+    }
+    auto end = std::chrono::steady_clock::now();
+    ts.w_scan = std::max(0.1, std::chrono::duration<double, std::nano>(end - start).count() / reps);
+
+    // keep the measured loops from being optimized away
+    volatile size_t sink = hits + positions;
+    (void) sink;
+
+    std::cout << "Cost Model: cell=[";
+    for (size_t d=0; d<Dim; ++d) {
+        std::cout << ts.w_cell[d] << (d+1<Dim ? "," : "");
+    }
+    std::cout << "] scan=" << ts.w_scan << " [ns]" << std::endl;
+}
+
+// a uniform sample of the points with a fixed random seed for reproduction
+inline Points sample_points(Points& points) {
+    if (points.size() <= tuning_sample_size) {
+        return points;
+    }
+    std::mt19937 gen(0);
+    std::uniform_int_distribution<size_t> pick(0, points.size() - 1);
+    Points sample;
+    sample.reserve(tuning_sample_size);
+    for (size_t i=0; i<tuning_sample_size; ++i) {
+        sample.emplace_back(points[pick(gen)]);
+    }
+    return sample;
+}
+
 };
 }
 }
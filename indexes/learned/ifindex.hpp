@@ -1,17 +1,24 @@
 #pragma once
 
+#include <array>
 #include <cstddef>
 #include <vector>
 #include <utility>
 #include <algorithm>
 #include <iostream>
 #include <chrono>
+#include <limits>
+#include <queue>
+#include <string>
 
 #include <boost/geometry/index/rtree.hpp>
 #include <boost/math/statistics/linear_regression.hpp>
 
+#include "../pgm/piecewise_linear_model.hpp"
 #include "../base_index.hpp"
 #include "../../utils/type.hpp"
+#include "../../utils/common.hpp"
+#include "../../utils/parallel.hpp"
 
 namespace bgi = boost::geometry::index;
 using boost::math::statistics::simple_ordinary_least_squares;
@@ -20,61 +27,74 @@ namespace bench { namespace index {
 
 // implementation of the IF-Index by augumenting boost rtree
 // the original paper uses linear interpolation whose error is generally large
-// instead, we train a simple linear regression model as a trade-off
-template<size_t Dim, size_t LeafNodeCap=2000, size_t MaxElements=32, size_t sort_dim=0>
+// instead, we train a simple linear regression model as a trade-off,
+// and fall back to a piecewise linear model for the leaves where its error is large
+// SortDim < Dim sorts every leaf on SortDim, by default each leaf picks the dimension of its widest extent
+// relative to the data, or to the queries if a sample query workload is given
+template<size_t Dim, size_t LeafNodeCap=2000, size_t MaxElements=32, size_t SortDim=Dim>
 class IFIndex : public BaseIndex {
 
 using Point = point_t<Dim>;
 using Points = std::vector<Point>;
 using Box = box_t<Dim>;
 
+// eps of the piecewise linear leaf models
+static constexpr size_t LeafEps = 16;
+// leaves whose linear regression error exceeds this use a piecewise linear model
+static constexpr size_t MaxLinearErr = 4 * LeafEps;
+
 public:
+// a segment of a piecewise linear leaf model, positions are relative to the first point of the leaf
+struct LeafSegment {
+    double key;
+    double slope;
+    int64_t intercept;
+};
+
 // class of Leaf Node
 class LeafNode {
     public:
-    std::vector<size_t> _ids;
-    Points _local_points;
+    // the points of the leaf are [begin, begin + count) of the leaf point arena, sorted by sort_dim
+    size_t begin;
     size_t count;
+    size_t sort_dim;
     // the maximum prediction error
     size_t max_err;
     // predicted pos = slope * point[sort_dim] + intercept
     double slope;
     double intercept;
+    // the piecewise linear model is [seg_begin, seg_begin + n_segs) of the segment arena, no segments for a linear model
+    size_t seg_begin;
+    size_t n_segs;
 
-    LeafNode(std::vector<size_t> ids, Points& points) : _ids(ids), count(ids.size()) {
-        std::vector<std::pair<size_t, double>> id_and_vals;
-        std::vector<double> vals, ys;
-
-        _local_points.reserve(count);
+    LeafNode() = default;
 
-        id_and_vals.reserve(count);
+    // the points of the leaf are sorted in place, segments receives the piecewise linear model if there is one
+    LeafNode(Points& arena, size_t first, size_t n, size_t dim, std::vector<LeafSegment>& segments)
+        : begin(first), count(n), sort_dim(dim), seg_begin(segments.size()), n_segs(0) {
+        std::vector<double> vals, ys;
         vals.resize(this->count);
         ys.resize(this->count);
 
-        for (auto id : _ids) {
-            id_and_vals.emplace_back(std::make_pair(id, points[id][sort_dim]));
-        }
-
         // sort the array by sort_dim
-        std::sort(id_and_vals.begin(), id_and_vals.end(), 
-            [](auto p1, auto p2){ return std::get<1>(p1) < std::get<1>(p2); });
+        auto pts = arena.begin() + begin;
+        std::sort(pts, pts + count, [dim](const Point& p1, const Point& p2) { return p1[dim] < p2[dim]; });
 
-        // un-tie pairs
         for (size_t i=0; i<count; ++i) {
-            _ids[i] = std::get<0>(id_and_vals[i]);
-            vals[i] = std::get<1>(id_and_vals[i]);
+            vals[i] = pts[i][dim];
             ys[i] = static_cast<double>(i);
         }
-
-        // update local points in the bucket
-        for (auto id : _ids) {
-            _local_points.emplace_back(points[id]);
-        }
         
         // train a linear regression model using ordinary least square
-        auto [a, b] = simple_ordinary_least_squares(vals, ys);
-        intercept = a;
-        slope = b;
+        // a leaf whose points share their value on the sort dimension maps them all to the first position
+        if (vals.front() < vals.back()) {
+            auto [a, b] = simple_ordinary_least_squares(vals, ys);
+            intercept = a;
+            slope = b;
+        } else {
+            intercept = 0.0;
+            slope = 0.0;
+        }
 
         // compute the max error
         max_err = 0;
@@ -83,6 +103,18 @@ class LeafNode {
             auto err = (pred >= i) ? (pred - i) : (i - pred);
             max_err = (err > max_err) ? err : max_err;
         }
+
+        // replace an inaccurate linear model by a piecewise linear one
+        // duplicate keys are skipped, a run of equal keys is mapped to its first position
+        if (max_err > MaxLinearErr) {
+            auto in_fun = [&vals](size_t i) { return std::pair<double, size_t>(vals[i], i); };
+            auto out_fun = [&segments](const auto& cs) {
+                auto [s, c] = cs.get_floating_point_segment(cs.get_first_x());
+                segments.push_back({cs.get_first_x(), static_cast<double>(s), static_cast<int64_t>(c)});
+            };
+            n_segs = pgm::internal::make_segmentation(count, LeafEps, in_fun, out_fun);
+            max_err = LeafEps + 1;
+        }
     }
 
     void print_model() {
@@ -102,48 +134,50 @@ class LeafNode {
 };
 
 
-using pack_rtree_t = bgi::rtree<std::pair<Point, size_t>, bgi::linear<LeafNodeCap>>;
 using index_rtree_t = bgi::rtree<std::pair<Box, LeafNode>, bgi::linear<MaxElements>>;
 
 
-IFIndex(Points& points) : _points(points) {
+IFIndex(Points& points, const std::vector<Box>& workload={}) : _points(points) {
     std::cout << "Construct IFIndex (on Rtree) " << "LeafNodeCap=" << LeafNodeCap 
-            << " MaxElements=" << MaxElements << " sort_dim=" << sort_dim << std::endl;
+            << " MaxElements=" << MaxElements << " SortDim=" << ((SortDim < Dim) ? std::to_string(SortDim) : "leaf")
+            << (workload.empty() ? "" : " Layout=learned") << std::endl;
 
     auto start = std::chrono::steady_clock::now();
 
-    std::vector<std::pair<Point, size_t>> point_with_id;
-    point_with_id.reserve(points.size());
-    size_t cnt = 0;
-    for (auto & p : points) {
-        point_with_id.emplace_back(p, (cnt++));
-    }
-
-    // run STR algorithm to bulk-load points
-    pack_rtree_t temp_rt(point_with_id.begin(), point_with_id.end());
-
-    // group leaf nodes
-    std::vector<std::pair<Box, LeafNode>> idx_data;
-    idx_data.reserve((points.size() / LeafNodeCap) + 1);
-    cnt = 0;
-    std::vector<size_t> temp_ids;
-    temp_ids.reserve(LeafNodeCap);
-    for (auto it=temp_rt.begin(); it!=temp_rt.end(); ++it) {
-        temp_ids.emplace_back(std::get<1>(*it));
-        if ((++cnt) % LeafNodeCap == 0) {
-            idx_data.emplace_back(compute_mbr(temp_ids, points), LeafNode(temp_ids, points));
-            temp_ids.clear();
-        }
-    }
-
-    if (temp_ids.size() != 0) {
-        idx_data.emplace_back(compute_mbr(temp_ids, points), LeafNode(temp_ids, points));
-        temp_ids.clear();
+    // the scale of each dimension when leaves pick their sort dimension
+    // a leaf is scanned on its sort dimension for queries that cut it, which is cheaper the wider
+    // the leaf is compared to the queries
+    compute_dim_scales(points, workload);
+
+    // bulk-load the leaves by STR partitioning of the points, which are then sorted in place within every leaf
+    this->_leaf_points = points;
+    auto slabs = bench::common::str_partition<Dim>(this->_leaf_points, LeafNodeCap,
+        [](const Point& p, size_t d) { return p[d]; });
+    const auto& leaves = slabs[Dim-1];
+    const size_t n_leaves = leaves.size() - 1;
+
+    // leaves are trained concurrently, their piecewise linear models are then concatenated in leaf order
+    std::vector<std::pair<Box, LeafNode>> idx_data(n_leaves);
+    std::vector<std::vector<LeafSegment>> leaf_segments(n_leaves);
+    bench::common::parallel_tasks(n_leaves, [&](size_t l) {
+        auto mbr = compute_mbr(leaves[l], leaves[l+1]);
+        auto dim = choose_sort_dim(mbr);
+        idx_data[l] = std::make_pair(mbr, LeafNode(this->_leaf_points, leaves[l], leaves[l+1] - leaves[l], dim, leaf_segments[l]));
+    });
+    for (size_t l=0; l<n_leaves; ++l) {
+        std::get<1>(idx_data[l]).seg_begin = this->_segments.size();
+        this->_segments.insert(this->_segments.end(), leaf_segments[l].begin(), leaf_segments[l].end());
     }
 
     // build index rtree
     _rt = new index_rtree_t(idx_data.begin(), idx_data.end());
 
+    size_t pla_leaves = 0;
+    for (auto& leaf : idx_data) {
+        pla_leaves += (std::get<1>(leaf).n_segs > 0);
+    }
+    std::cout << "Leaves: " << idx_data.size() << " PLA Leaves: " << pla_leaves << std::endl;
+
     auto end = std::chrono::steady_clock::now();
     build_time = std::chrono::duration_cast<std::chrono::milliseconds>(end - start).count();
     std::cout << "Build Time: " << get_build_time() << " [ms]" << std::endl;
@@ -161,30 +195,44 @@ inline size_t count() {
 // the index size is the sum of rtree and all identifiers
 inline size_t index_size() {
     auto rt_size = bench::common::get_boost_rtree_statistics(*(this->_rt));
-    return rt_size + count() * sizeof(size_t);
+    return rt_size + this->_segments.size() * sizeof(LeafSegment) + count() * sizeof(size_t);
 }
 
 Points range_query(Box& box) {
     auto start = std::chrono::steady_clock::now();
 
     Points result;
-    // for leaf nodes covered by the query box
-    // directly insert points to the result set
-    for (auto it=_rt->qbegin(bgi::covered_by(box)); it!=_rt->qend(); ++it) {
-        for (auto p : std::get<1>(*it)._local_points) {
-            result.emplace_back(p);
+    // a single traversal over the leaf nodes that intersect the query box
+    // the points of leaf nodes covered by the query box are directly inserted to the result set,
+    // for the other leaf nodes the points within the query on the sort dimension are located by the leaf model
+    // and checked against the query box on the dimensions that cut the leaf
+    for (auto it=_rt->qbegin(bgi::intersects(box)); it!=_rt->qend(); ++it) {
+        const Box& mbr = std::get<0>(*it);
+        const LeafNode& leaf = std::get<1>(*it);
+
+        uint32_t mask = 0;
+        for (size_t i=0; i<Dim; ++i) {
+            if (mbr.min_corner()[i] < box.min_corner()[i] || mbr.max_corner()[i] > box.max_corner()[i]) {
+                mask |= (1u << i);
+            }
         }
-    }
 
-    // for leaf nodes overlaps the query box 
-    // check whether the points are in the query range
-    for (auto it=_rt->qbegin(bgi::overlaps(box)); it!=_rt->qend(); ++it) {
-        const LeafNode& leaf = std::get<1>(*it);
-        auto [lo, hi] = search_leaf(leaf, box);
-        for (auto i=lo; i<=hi; ++i) {
-            Point temp_p = leaf._local_points[i];
-            if (bench::common::is_in_box(temp_p, box)) {
-                result.emplace_back(temp_p);
+        size_t lo = 0, hi = leaf.count;
+        if (mask & (1u << leaf.sort_dim)) {
+            lo = leaf_lower_bound(leaf, box.min_corner()[leaf.sort_dim]);
+            hi = leaf_upper_bound(leaf, box.max_corner()[leaf.sort_dim]);
+            mask &= ~(1u << leaf.sort_dim);
+        }
+
+        auto first = this->_leaf_points.begin() + leaf.begin;
+        if (mask == 0) {
+            result.insert(result.end(), first + lo, first + hi);
+            continue;
+        }
+        for (auto i=lo; i<hi; ++i) {
+            Point& p = first[i];
+            if (bench::common::is_in_box_on(p, box, mask)) {
+                result.emplace_back(p);
             }
         }
     }
@@ -197,19 +245,101 @@ Points range_query(Box& box) {
     return result;
 }
 
+// exact knn query
+// leaf nodes are visited best-first in increasing distance of their MBRs from the query point
+// until the next MBR is farther than the k-th point found
+Points knn_query(Point& point, size_t k) {
+    auto start = std::chrono::steady_clock::now();
+
+    // the k closest points found so far, a max-heap on squared distance
+    std::priority_queue<std::pair<double, size_t>> knn;
+
+    if (k > 0) {
+        for (auto it=_rt->qbegin(bgi::nearest(point, static_cast<unsigned>(_rt->size()))); it!=_rt->qend(); ++it) {
+            if (knn.size() == k && boost::geometry::comparable_distance(point, std::get<0>(*it)) >= knn.top().first) {
+                break;
+            }
+            scan_leaf(knn, point, k, std::get<1>(*it));
+        }
+    }
+
+    auto end = std::chrono::steady_clock::now();
+    knn_time += std::chrono::duration_cast<std::chrono::microseconds>(end - start).count();
+    knn_count ++;
+
+    Points knn_result(knn.size());
+    for (size_t i=knn.size(); i-- > 0; ) {
+        knn_result[i] = this->_leaf_points[knn.top().second];
+        knn.pop();
+    }
+
+    return knn_result;
+}
+
 private:
 Points& _points;
 index_rtree_t* _rt;
 
-inline Box compute_mbr(std::vector<size_t>& ids, Points& points) {
+// the points of all leaf nodes, stored contiguously leaf by leaf
+Points _leaf_points;
+// the segments of all piecewise linear leaf models
+std::vector<LeafSegment> _segments;
+// the average query extent on each dimension, or the data extent without a query workload
+std::array<double, Dim> _dim_scales;
+
+inline void compute_dim_scales(Points& points, const std::vector<Box>& workload) {
+    std::fill(_dim_scales.begin(), _dim_scales.end(), 0.0);
+    if (!workload.empty()) {
+        for (const auto& q : workload) {
+            for (size_t i=0; i<Dim; ++i) {
+                _dim_scales[i] += (q.max_corner()[i] - q.min_corner()[i]) / workload.size();
+            }
+        }
+        return;
+    }
+
+    Point mins, maxs;
+    std::fill(mins.begin(), mins.end(), std::numeric_limits<double>::max());
+    std::fill(maxs.begin(), maxs.end(), std::numeric_limits<double>::lowest());
+    for (auto& p : points) {
+        for (size_t i=0; i<Dim; ++i) {
+            mins[i] = std::min(p[i], mins[i]);
+            maxs[i] = std::max(p[i], maxs[i]);
+        }
+    }
+    for (size_t i=0; i<Dim; ++i) {
+        _dim_scales[i] = maxs[i] - mins[i];
+    }
+}
+
+// the sort dimension of a leaf is the one of its widest extent relative to the dimension scales
+inline size_t choose_sort_dim(const Box& mbr) {
+    if (SortDim < Dim) {
+        return SortDim;
+    }
+
+    size_t dim = 0;
+    double widest = -1.0;
+    for (size_t i=0; i<Dim; ++i) {
+        double width = (_dim_scales[i] > 0) ? (mbr.max_corner()[i] - mbr.min_corner()[i]) / _dim_scales[i] : 0.0;
+        if (width > widest) {
+            widest = width;
+            dim = i;
+        }
+    }
+    return dim;
+}
+
+// the MBR of the points [first, last) of the leaf point arena
+inline Box compute_mbr(size_t first, size_t last) {
     Point mins, maxs;
     std::fill(mins.begin(), mins.end(), std::numeric_limits<double>::max());
-    std::fill(maxs.begin(), maxs.end(), std::numeric_limits<double>::min());
+    std::fill(maxs.begin(), maxs.end(), std::numeric_limits<double>::lowest());
 
     for (size_t i=0; i<Dim; ++i) {
-        for (auto id : ids) {
-            mins[i] = std::min(points[id][i], mins[i]);
-            maxs[i] = std::max(points[id][i], maxs[i]);
+        for (auto j=first; j<last; ++j) {
+            mins[i] = std::min(this->_leaf_points[j][i], mins[i]);
+            maxs[i] = std::max(this->_leaf_points[j][i], maxs[i]);
         }
     }
 
@@ -217,6 +347,19 @@ inline Box compute_mbr(std::vector<size_t>& ids, Points& points) {
 }
 
 inline size_t predict(const LeafNode& leaf, double val) {
+    if (leaf.n_segs > 0) {
+        const LeafSegment* segs = this->_segments.data() + leaf.seg_begin;
+        auto it = std::upper_bound(segs, segs + leaf.n_segs, val,
+            [](double v, const LeafSegment& seg) { return v < seg.key; });
+        if (it == segs) {
+            return 0;
+        }
+        --it;
+        int64_t pos = static_cast<int64_t>(it->slope * (val - it->key)) + it->intercept;
+        int64_t cap = (it + 1 < segs + leaf.n_segs) ? (it + 1)->intercept : static_cast<int64_t>(leaf.count - 1);
+        return static_cast<size_t>(std::clamp<int64_t>(pos, 0, cap));
+    }
+
     double guess = leaf.slope * val + leaf.intercept;
     if (guess < 0) {
         return 0;
@@ -227,14 +370,75 @@ inline size_t predict(const LeafNode& leaf, double val) {
     return static_cast<size_t>(guess);
 }
 
-inline std::pair<size_t, size_t> search_leaf(const LeafNode& leaf, Box& box) {
-    size_t pred_min = predict(leaf, box.min_corner()[sort_dim]);
-    size_t pred_max = predict(leaf, box.max_corner()[sort_dim]);
-    size_t lo = (leaf.max_err > pred_min) ? 0 : (pred_min - leaf.max_err);
-    size_t hi = ((pred_max + leaf.max_err + 1) > leaf.count) ? (leaf.count - 1) : (pred_max + leaf.max_err);
+// the first position in a leaf whose value on the sort dimension is not less than val (lower bound)
+// or greater than val (upper bound)
+// the model predicts it within max_err, the whole leaf is searched if the window does not contain it
+inline size_t leaf_lower_bound(const LeafNode& leaf, double val) {
+    const size_t d = leaf.sort_dim;
+    auto pts = this->_leaf_points.begin() + leaf.begin;
+    auto [lo, hi] = leaf_window(leaf, val);
+    if ((lo > 0 && pts[lo-1][d] >= val) || (hi < leaf.count && pts[hi][d] < val)) {
+        lo = 0;
+        hi = leaf.count;
+    }
+    return std::lower_bound(pts + lo, pts + hi, val,
+        [d](const Point& p, double v) { return p[d] < v; }) - pts;
+}
+
+inline size_t leaf_upper_bound(const LeafNode& leaf, double val) {
+    const size_t d = leaf.sort_dim;
+    auto pts = this->_leaf_points.begin() + leaf.begin;
+    auto [lo, hi] = leaf_window(leaf, val);
+    if ((lo > 0 && pts[lo-1][d] > val) || (hi < leaf.count && pts[hi][d] <= val)) {
+        lo = 0;
+        hi = leaf.count;
+    }
+    return std::upper_bound(pts + lo, pts + hi, val,
+        [d](double v, const Point& p) { return v < p[d]; }) - pts;
+}
+
+inline std::pair<size_t, size_t> leaf_window(const LeafNode& leaf, double val) {
+    size_t pred = predict(leaf, val);
+    size_t lo = (leaf.max_err > pred) ? 0 : (pred - leaf.max_err);
+    size_t hi = std::min(leaf.count, pred + leaf.max_err + 2);
     return std::make_pair(lo, hi);
 }
 
+// update the knn heap with the points of a leaf
+// the scan starts at the position of the query on the sort dimension and expands to the closer side
+// until the gap on the sort dimension alone exceeds the k-th distance
+inline void scan_leaf(std::priority_queue<std::pair<double, size_t>>& knn, Point& q, size_t k, const LeafNode& leaf) {
+    auto pts = this->_leaf_points.begin() + leaf.begin;
+    const size_t n = leaf.count;
+    if (n == 0) {
+        return;
+    }
+
+    const size_t d = leaf.sort_dim;
+    const double key = q[d];
+    size_t left = leaf_lower_bound(leaf, key);
+    size_t right = left;
+
+    // the window [left, right) has been scanned
+    while (left > 0 || right < n) {
+        double gap_left = (left > 0) ? key - pts[left - 1][d] : std::numeric_limits<double>::infinity();
+        double gap_right = (right < n) ? pts[right][d] - key : std::numeric_limits<double>::infinity();
+        double gap = std::min(gap_left, gap_right);
+        if (knn.size() == k && gap * gap >= knn.top().first) {
+            break;
+        }
+
+        size_t i = leaf.begin + ((gap_left <= gap_right) ? --left : right++);
+        double dist = bench::common::eu_dist_square(this->_leaf_points[i], q);
+        if (knn.size() < k) {
+            knn.emplace(dist, i);
+        } else if (dist < knn.top().first) {
+            knn.pop();
+            knn.emplace(dist, i);
+        }
+    }
+}
+
 };
 
 }
@@ -1,17 +1,18 @@
 #pragma once
 
+#include <algorithm>
+#include <array>
+#include <cmath>
 #include <cstddef>
+#include <limits>
 #include <vector>
 #include <chrono>
-#include <boost/geometry/index/rtree.hpp>
 
 #include "../pgm/pgm_index.hpp"
 #include "../base_index.hpp"
 #include "../../utils/type.hpp"
 #include "../../utils/common.hpp"
-
-
-namespace bgi = boost::geometry::index;
+#include "../../utils/parallel.hpp"
 
 namespace bench { namespace index {
 
@@ -23,54 +24,63 @@ using Box = box_t<Dim>;
 using Points = std::vector<Point>;
 using PGMIndex = pgm::PGMIndex<double, Epsilon>;
 
-struct Bucket {
-    size_t id;
-    double volume;
-
-    Bucket(size_t _id, double _volume) : id(_id), volume(_volume) {}
-};
-
-using packing_rtree_t = bgi::rtree<Point, bgi::linear<BucketSize>>;
-using grid_rtree_t = bgi::rtree<std::pair<Box, Bucket>, bgi::linear<32>>;
-
 
 public:
 LISA(Points& points) {
     auto start = std::chrono::steady_clock::now();
     
     // compute a grid index layout using STR packing
-    std::vector<std::pair<Box, Bucket>> grid_buckets;
-    grid_buckets.reserve((points.size() + BucketSize - 1) / BucketSize);
-
-    packing_rtree_t temp_rt(points.begin(), points.end());
-    Points temp_pts;
-    temp_pts.reserve(BucketSize);
-    size_t cnt = 0;
-    size_t grid_id = 0;
-    for (auto it=temp_rt.begin(); it!=temp_rt.end(); ++it) {
-        temp_pts.emplace_back(*it);
-        if ((++cnt) % BucketSize == 0) {
-            auto mbr = compute_mbr(temp_pts);
-            grid_buckets.emplace_back(mbr, Bucket(grid_id++, compute_volume(mbr)));
-            temp_pts.clear();
+    // the points are sorted and cut into slabs on the first dimension, every slab is sorted and cut on the
+    // second dimension and so on, the slabs of the last dimension hold BucketSize points and are the grid cells
+    // cells are numbered in slab order, so a point that dominates another is never in a cell with a smaller id
+    Points temp_pts(points);
+    auto slabs = bench::common::str_partition<Dim>(temp_pts, BucketSize, [](const Point& p, size_t d) { return p[d]; });
+
+    // the slabs on dimension d within each slab on dimension d-1 and their extent
+    // a slab extends to the lower bound of the next slab, the last one to its largest point
+    std::vector<size_t> parents = {0, temp_pts.size()};
+    std::vector<Box> boxes(1);
+    for (size_t d=0; d<Dim; ++d) {
+        std::vector<Box> slab_boxes;
+        _slab_begin[d].assign(1, 0);
+
+        size_t j = 0;
+        for (size_t r=0; r+1<parents.size(); ++r) {
+            size_t first = j;
+            for (; j+1<slabs[d].size() && slabs[d][j]<parents[r+1]; ++j) {
+                double lo = std::numeric_limits<double>::max(), hi = std::numeric_limits<double>::lowest();
+                for (size_t i=slabs[d][j]; i<slabs[d][j+1]; ++i) {
+                    lo = std::min(lo, temp_pts[i][d]);
+                    hi = std::max(hi, temp_pts[i][d]);
+                }
+                _slab_lo[d].emplace_back(lo);
+                slab_boxes.emplace_back(boxes[r]);
+                slab_boxes.back().min_corner()[d] = lo;
+                slab_boxes.back().max_corner()[d] = hi;
+            }
+            for (size_t k=first; k+1<j; ++k) {
+                slab_boxes[k].max_corner()[d] = _slab_lo[d][k+1];
+            }
+            _slab_begin[d].emplace_back(_slab_lo[d].size());
         }
-    }
 
-    if (temp_pts.size() != 0) {
-        auto mbr = compute_mbr(temp_pts);
-        grid_buckets.emplace_back(mbr, Bucket(grid_id++, compute_volume(mbr)));
-        temp_pts.clear();
+        parents = slabs[d];
+        boxes.swap(slab_boxes);
     }
 
-    // build rtree for indexing grid buckets
-    _grid_rt = new grid_rtree_t(grid_buckets.begin(), grid_buckets.end());
+    this->_cells.swap(boxes);
+    this->_volumes.reserve(_cells.size());
+    for (auto& cell : this->_cells) {
+        this->_volumes.emplace_back(compute_volume(cell));
+    }
 
     // sort data by projections and train CDF model
-    std::vector<std::pair<Point, double>> point_with_proj;
-    point_with_proj.reserve(points.size());
-    for (auto& p : points) {
-        point_with_proj.emplace_back(p, project(p));
-    }
+    std::vector<std::pair<Point, double>> point_with_proj(points.size());
+    bench::common::parallel_for(points.size(), [&](size_t lo, size_t hi) {
+        for (size_t i=lo; i<hi; ++i) {
+            point_with_proj[i] = std::make_pair(points[i], project(points[i]));
+        }
+    });
 
     std::sort(point_with_proj.begin(), point_with_proj.end(), 
         [](auto p1, auto p2) { return std::get<1>(p1) < std::get<1>(p2); });
@@ -84,31 +94,11 @@ LISA(Points& points) {
         projections.emplace_back(std::get<1>(pp));
     }
 
-    // for (size_t i=0; i<10; ++i) {
-    //     auto idx = 5000 * i;
-    //     std::cout << "id: " << idx << " val: " << projections[idx] << std::endl;
-    //     bench::common::print_point(_data[idx]);
-    //     print_bucket_to_point(_data[idx]);
-        
-
-    //     std::cout << "id: " << idx+1 << " val: " << projections[idx+1] << std::endl;
-    //     bench::common::print_point(_data[idx+1]);
-    //     print_bucket_to_point(_data[idx+1]);
-    //     std::cout << "===========" <<std::endl;
-    // }
-
-    // resolve the duplicate key problem caused by points exactly on the grid boundary
-    for (size_t i=0; i<projections.size(); ++i) {
-        if (i % BucketSize == 0) {
-            for (size_t j=i; j<i+Dim; ++j) {
-                projections[j] += (j - i + 1) * 0.00000000001;
-            }
-        }
-    }
-    
-    for (size_t i=0; i<projections.size()-1; ++i) {
-        if (projections[i] == projections[i+1]) {
-            std::cout << "duplicate id: " << i << " val: " << projections[i] << std::endl;
+    // make sure there is no duplicate keys, e.g., duplicate points or points exactly on a cell boundary
+    // keys are only moved up by a few ulps, the range query extends its window past the ties at the upper end
+    for (size_t i=1; i<projections.size(); ++i) {
+        if (projections[i] <= projections[i-1]) {
+            projections[i] = std::nextafter(projections[i-1], std::numeric_limits<double>::infinity());
         }
     }
 
@@ -121,7 +111,6 @@ LISA(Points& points) {
 }
 
 ~LISA() {
-    delete this->_grid_rt;
     // delete this->_pgm_idx;
 }
 
@@ -129,11 +118,16 @@ LISA(Points& points) {
 Points range_query(Box& box) {
     auto start = std::chrono::steady_clock::now();
 
+    auto key_hi = project(box.max_corner());
     auto range_min = this->_pgm_idx->search(project(box.min_corner()));
-    auto range_max = this->_pgm_idx->search(project(box.max_corner()));
+    auto range_max = this->_pgm_idx->search(key_hi);
 
     auto it_lo = this->_data.begin() + range_min.lo;
     auto it_hi = this->_data.begin() + range_max.hi;
+    // the points tied with the max corner may have been moved past the window
+    while (it_hi != this->_data.end() && project(*it_hi) <= key_hi) {
+        ++it_hi;
+    }
 
     Points result;
     for (auto it=it_lo; it!=it_hi; ++it) {
@@ -155,52 +149,63 @@ inline size_t count() {
 
 
 inline size_t index_size() {
-    auto grid_size = bench::common::get_boost_rtree_statistics(*(this->_grid_rt));
+    size_t grid_size = this->_cells.size() * (sizeof(Box) + sizeof(double));
+    for (size_t d=0; d<Dim; ++d) {
+        grid_size += this->_slab_lo[d].size() * sizeof(double) + this->_slab_begin[d].size() * sizeof(size_t);
+    }
     auto pgm_size = this->_pgm_idx->size_in_bytes();
     return grid_size + pgm_size + count() * sizeof(size_t);
 }
 
 inline void print_bucket_to_point(Point& p) {
-    auto q_result = *(this->_grid_rt->qbegin(bgi::intersects(p)));
-    std::cout << "bucket id: " << q_result.second.id << " vol: " << q_result.second.volume << std::endl;
-    bench::common::print_box(q_result.first);
+    auto id = locate(p);
+    std::cout << "bucket id: " << id << " vol: " << _volumes[id] << std::endl;
+    bench::common::print_box(_cells[id]);
 }
 
 inline void print_buckets() {
-    for (auto it=_grid_rt->begin(); it!=_grid_rt->end(); ++it) {
-        auto p = *it;
-        std::cout << "ID: " << p.second.id << " Volume: " << p.second.volume << std::endl;
-        bench::common::print_box(p.first);
+    for (size_t id=0; id<_cells.size(); ++id) {
+        std::cout << "ID: " << id << " Volume: " << _volumes[id] << std::endl;
+        bench::common::print_box(_cells[id]);
     }
 }
 
 inline double project(Point& point) {
-    auto q_result = *(this->_grid_rt->qbegin(bgi::intersects(point)));
-    auto relative_vol = compute_volume(q_result.first, point);
-    return static_cast<double>(q_result.second.id) + relative_vol / q_result.second.volume;
+    auto id = locate(point);
+    if (this->_volumes[id] <= 0) {
+        return static_cast<double>(id);
+    }
+    auto relative_vol = compute_volume(_cells[id], point);
+    return static_cast<double>(id) + relative_vol / this->_volumes[id];
 }
 
 private:
 Points _data;
-grid_rtree_t* _grid_rt;
 PGMIndex* _pgm_idx;
 
+// STR slabs, the slabs on dimension d cut by the slab s on dimension d-1 are [_slab_begin[d][s], _slab_begin[d][s+1])
+// of _slab_lo[d], which holds the lower bound of each slab
+std::array<std::vector<double>, Dim> _slab_lo;
+std::array<std::vector<size_t>, Dim> _slab_begin;
 
-inline Box compute_mbr(Points& pts) {
-    Point mins, maxs;
-    std::fill(mins.begin(), mins.end(), std::numeric_limits<double>::max());
-    std::fill(maxs.begin(), maxs.end(), std::numeric_limits<double>::min());
+// the extent and the volume of each grid cell, i.e., each slab on the last dimension
+std::vector<Box> _cells;
+std::vector<double> _volumes;
 
-    for (size_t i=0; i<Dim; ++i) {
-        for (auto& pt : pts) {
-            mins[i] = std::min(pt[i], mins[i]);
-            maxs[i] = std::max(pt[i], maxs[i]);
-        }
-    }
 
-    return Box(mins, maxs);
+// the cell of a point, a binary search over the slab boundaries on each dimension
+// points on a boundary belong to the upper slab and points outside the data to the closest slab
+inline size_t locate(Point& point) {
+    size_t slab = 0;
+    for (size_t d=0; d<Dim; ++d) {
+        auto first = _slab_lo[d].begin() + _slab_begin[d][slab];
+        auto last = _slab_lo[d].begin() + _slab_begin[d][slab+1];
+        slab = std::upper_bound(first + 1, last, point[d]) - _slab_lo[d].begin() - 1;
+    }
+    return slab;
 }
 
+
 inline double compute_volume(Box& box) {
     auto min_pt = box.min_corner();
     auto max_pt = box.max_corner();
@@ -214,12 +219,15 @@ inline double compute_volume(Box& box) {
     return vol;
 }
 
+// the volume between the min corner of a box and a point, clamped to the box
+// so that the corners of a query box outside the cell still get a projection within the cell
 inline double compute_volume(Box& box, Point& pt) {
     auto min_pt = box.min_corner();
+    auto max_pt = box.max_corner();
 
     double vol = 1.0;
     for (size_t i=0; i<Dim; ++i) {
-        vol *= (100.0 * (pt[i] - min_pt[i]));
+        vol *= (100.0 * std::max(0.0, std::min(pt[i], max_pt[i]) - min_pt[i]));
     }
     
     return vol;
@@ -1,17 +1,49 @@
 #pragma once
 
+#include <algorithm>
 #include <cstddef>
+#include <cstdint>
+#include <cmath>
 #include <array>
 #include <chrono>
+#include <functional>
+#include <limits>
+#include <queue>
 #include "../../utils/type.hpp"
 #include "../../utils/common.hpp"
-#include "../pgm/pgm_index.hpp"
+#include "../../utils/parallel.hpp"
 #include "../base_index.hpp"
+#include "../pgm/pgm_index.hpp"
 
 namespace bench { namespace index {
 
-template<size_t Dim, size_t K, size_t Epsilon=64>
-class LISA2 : public BaseIndex {
+// cell layouts of LISA
+// a layout partitions the space into cells and projects the points of cell id to keys in [id, id+1]
+// that are monotone on every dimension within the cell, it also enumerates the cells intersected by a box
+// together with the dimensions that cut them, and the cells in increasing distance from a point
+
+// the LISA projection of a point to the key space of cell id, whose lower corner is lo and whose volume is volume
+// offsets below the cell are clamped to 0, so the projection is also defined for the corners of a query box
+template<size_t Dim>
+inline double lisa_project(const point_t<Dim>& point, const point_t<Dim>& lo, const point_t<Dim>& mins,
+                           const point_t<Dim>& maxs, size_t id, double volume) {
+    double vol = 10.0;
+
+    for (size_t i=0; i<Dim; ++i) {
+        if (point[i] <= mins[i]) {
+            vol = 0.0;
+        } else {
+            vol *= (100 * std::max(0.0, std::min(point[i], maxs[i]) - lo[i]));
+        }
+    }
+
+    return (volume > 0) ? static_cast<double>(id) + vol / volume : static_cast<double>(id);
+}
+
+
+// K equal-depth columns on every dimension, chosen independently as in the original LISA
+template<size_t Dim, size_t K>
+class EqualDepthCells {
 
 using Point = point_t<Dim>;
 using Box = box_t<Dim>;
@@ -19,14 +51,10 @@ using Points = std::vector<Point>;
 using Partition = std::array<double, K>;
 using Partitions = std::array<Partition, Dim>;
 
-using PGMIdx = pgm::PGMIndex<double, Epsilon>;
-
 public:
+static constexpr const char* name = "grid";
 
-LISA2(Points& points) {
-    std::cout << "Construct LISA " << "K=" << K << " Epsilon=" << Epsilon << std::endl;
-
-    auto start = std::chrono::steady_clock::now();
+void build(Points& points) {
     // dimension offsets when computing bucket ID
     for (size_t i=0; i<Dim; ++i) {
         this->dim_offset[i] = bench::common::ipow(K, i);
@@ -34,9 +62,7 @@ LISA2(Points& points) {
 
     auto bucket_size = points.size() / K;
 
-    this->min_width = std::numeric_limits<double>::max();
-
-    // compute equal depth partition boundaries 
+    // compute equal depth partition boundaries
     for (size_t i=0; i<Dim; ++i) {
         std::vector<double> dim_vector;
         dim_vector.reserve(points.size());
@@ -56,20 +82,11 @@ LISA2(Points& points) {
 
         mins[i] = dim_vector.front();
         maxs[i] = dim_vector.back();
-
-        this->min_width = std::min(this->min_width, (maxs[i] - mins[i]));
     }
 
     // initialize volumes of grid cells
-    std::array<size_t, Dim> comb;
     for (size_t i = 0; i < volumes.size(); ++i) {
-        auto I = i;
-        for (size_t j = 0; j < Dim; ++j) {
-            comb[j] = I % K;
-            I /= K;
-        }
-
-        auto bucket_id = compute_id(comb);
+        auto comb = decode_id(i);
         double vol = 10.0;
         for (size_t d=0; d<Dim; ++d) {
             if (comb[d] == (K-1)) {
@@ -78,7 +95,7 @@ LISA2(Points& points) {
                 vol *= (100 * (this->partitions[d][comb[d]+1] - this->partitions[d][comb[d]]));
             }
         }
-        this->volumes[bucket_id] = vol;
+        this->volumes[i] = vol;
     }
 
     // make sure all volumes are well initialized
@@ -86,260 +103,685 @@ LISA2(Points& points) {
         assert(v > 0);
     }
 
-    // compute projections and sort points by projections
-    std::vector<std::pair<size_t, double>> pid_and_projection;
-    pid_and_projection.reserve(points.size());
-    size_t pid = 0;
+    // the extent of the points of every column on each dimension
+    for (auto& col : col_mins) {
+        std::fill(col.begin(), col.end(), std::numeric_limits<double>::infinity());
+    }
+    for (auto& col : col_maxs) {
+        std::fill(col.begin(), col.end(), -std::numeric_limits<double>::infinity());
+    }
     for (auto& p : points) {
-        pid_and_projection.emplace_back(pid++, project(p));
+        extend(p);
     }
 
-    std::sort(pid_and_projection.begin(), pid_and_projection.end(), 
-        [](auto p1, auto p2) { return std::get<1>(p1) < std::get<1>(p2); });
+    std::array<size_t, Dim> columns;
+    std::fill(columns.begin(), columns.end(), K);
+    this->cell_search = bench::common::GridBestFirst<Dim>(columns);
+}
+
+inline size_t size() const {
+    return volumes.size();
+}
+
+inline size_t size_in_bytes() const {
+    // partitions, column extents and volumes
+    return 3 * K * Dim * sizeof(double) + volumes.size() * sizeof(double) + cell_search.size_in_bytes();
+}
 
-    std::vector<double> projections;
-    projections.reserve(points.size());
-    this->_data.reserve(points.size());
+inline size_t locate(const Point& p) const {
+    size_t id = 0;
+    for (size_t i=0; i<Dim; ++i) {
+        id += get_dim_idx(p, i) * dim_offset[i];
+    }
+    return id;
+}
 
-    for (auto& pp : pid_and_projection) {
-        this->_data.emplace_back(points[std::get<0>(pp)]);
-        projections.emplace_back(std::get<1>(pp));
+inline double project(const Point& p, size_t cell) const {
+    auto comb = decode_id(cell);
+    Point lo;
+    for (size_t i=0; i<Dim; ++i) {
+        lo[i] = partitions[i][comb[i]];
     }
+    return lisa_project<Dim>(p, lo, mins, maxs, cell, volumes[cell]);
+}
 
-    // make sure there is no duplicate keys
-    for (size_t i=0; i<points.size()-1; ++i) {
-        if (projections[i] == projections[i+1]) { 
-            projections[i+1] = (projections[i] + projections[i+2]) / 2.0;
+// the extents only grow, after removes they still bound the points of each column
+inline void extend(const Point& p) {
+    for (size_t i=0; i<Dim; ++i) {
+        auto idx = get_dim_idx(p, i);
+        col_mins[i][idx] = std::min(col_mins[i][idx], p[i]);
+        col_maxs[i][idx] = std::max(col_maxs[i][idx], p[i]);
+    }
+}
+
+// f(cell, mask) for every cell intersected by the box, bit d of mask is set if dimension d cuts the cell
+template<typename F>
+inline void for_each_cell(Box& box, F f) {
+    std::array<bench::common::ColumnSpan, Dim> spans;
+    for (size_t i=0; i<Dim; ++i) {
+        if (!bench::common::column_span(get_dim_idx(box.min_corner(), i), get_dim_idx(box.max_corner(), i),
+                box.min_corner()[i], box.max_corner()[i], col_mins[i].data(), col_maxs[i].data(), spans[i])) {
+            return;
         }
     }
-    
-    // train 1-D learned index on projections
-    this->_pgm_ptr = new PGMIdx(projections);
 
-    auto end = std::chrono::steady_clock::now();
-    build_time = std::chrono::duration_cast<std::chrono::milliseconds>(end - start).count();
-    std::cout << "Build Time: " << get_build_time() << " [ms]" << std::endl;
-    std::cout << "Index Size: " << index_size() << " Bytes" << std::endl;
+    bench::common::for_each_cell_run(spans, dim_offset, [&f](size_t first, size_t last, uint32_t mask) {
+        for (auto cell=first; cell<=last; ++cell) {
+            f(cell, mask);
+        }
+    });
 }
 
-~LISA2() {
-    delete this->_pgm_ptr;
+// visit(cell, min_dist_square) in increasing min_dist_square until it returns false
+template<typename F>
+inline void nearest_cells(Point& q, F visit) {
+    std::array<size_t, Dim> start_cell;
+    for (size_t i=0; i<Dim; ++i) {
+        start_cell[i] = get_dim_idx(q, i);
+    }
+
+    // the first and the last columns extend to infinity, queries may lie outside the data
+    auto bounds = [this](size_t d, size_t idx) {
+        double lo = (idx == 0) ? -std::numeric_limits<double>::infinity() : partitions[d][idx];
+        double hi = (idx == K-1) ? std::numeric_limits<double>::infinity() : partitions[d][idx+1];
+        return std::make_pair(lo, hi);
+    };
+
+    this->cell_search.search(q, start_cell, bounds, [&visit](size_t cell_id, auto&, double min_dist_square) {
+        return visit(cell_id, min_dist_square);
+    });
 }
 
-inline size_t count() {
-    return this->_data.size();
+private:
+// dimension offsets in bucket array
+std::array<size_t, Dim> dim_offset;
+
+// bucket boundaries on each dimension
+Partitions partitions;
+
+// min corner
+Point mins;
+
+// max corner
+Point maxs;
+
+// pre-computed grid volumes
+std::array<double, bench::common::ipow(K, Dim)> volumes;
+
+// extent of the points of each column on each dimension
+Partitions col_mins;
+Partitions col_maxs;
+
+// best-first traversal of grid cells for knn queries
+bench::common::GridBestFirst<Dim> cell_search;
+
+inline std::array<size_t, Dim> decode_id(size_t id) const {
+    std::array<size_t, Dim> comb;
+    for (size_t i=0; i<Dim; ++i) {
+        comb[i] = id % K;
+        id /= K;
+    }
+    return comb;
 }
 
-inline size_t index_size() {
-    size_t partition_size = K * Dim * sizeof(double);
-    size_t volume_size = this->volumes.size() * sizeof(double);
-    size_t pgm_size = this->_pgm_ptr->size_in_bytes();
-    return partition_size + volume_size + pgm_size + count() * sizeof(size_t);
+inline size_t get_dim_idx(const Point& p, size_t d) const {
+    if (p[d] <= partitions[d][0]) {
+        return 0;
+    } else {
+        auto upper = std::upper_bound(partitions[d].begin(), partitions[d].end(), p[d]);
+        return (size_t) (upper - partitions[d].begin() - 1);
+    }
 }
 
-Points range_query(Box& box) {
-    auto start = std::chrono::steady_clock::now();
-    std::vector<std::pair<size_t, size_t>> ranges;
-    find_intersect_ranges(ranges, box);
+};
 
-    Points result;
-    for (const auto& range : ranges) {
-        search_range(result, static_cast<double>(std::get<0>(range)), static_cast<double>(std::get<1>(range)+1), box);
+
+// the leaves of a kd-tree built by recursive median splits on the dimension of the widest spread
+// unlike the grid, the cells adapt to the joint distribution: every cell holds at most about N / K^Dim points
+// (and at least MinCellSize), only runs of equal coordinates can exceed the bound
+// every node keeps the extent of its points, which prunes range and knn searches
+template<size_t Dim, size_t K>
+class KDCells {
+
+using Point = point_t<Dim>;
+using Box = box_t<Dim>;
+using Points = std::vector<Point>;
+
+static constexpr size_t MinCellSize = 16;
+static constexpr uint32_t Leaf = std::numeric_limits<uint32_t>::max();
+
+// nodes are stored in preorder, so the left child of an inner node directly follows it
+// inner nodes send points with p[dim] < split to the left, leaves store their cell id in child
+struct Node {
+    double split;
+    uint32_t dim;
+    uint32_t child;
+};
+
+public:
+static constexpr const char* name = "kd";
+
+void build(Points& points) {
+    const size_t n = points.size();
+    mins.fill(std::numeric_limits<double>::max());
+    maxs.fill(std::numeric_limits<double>::lowest());
+    for (const auto& p : points) {
+        for (size_t i=0; i<Dim; ++i) {
+            mins[i] = std::min(mins[i], p[i]);
+            maxs[i] = std::max(maxs[i], p[i]);
+        }
     }
 
-    auto end = std::chrono::steady_clock::now();
-    range_time += std::chrono::duration_cast<std::chrono::microseconds>(end - start).count();
-    range_count ++;
+    // as many cells as the grid, but not smaller than MinCellSize
+    size_t cells = 1;
+    for (size_t i=0; i<Dim; ++i) {
+        cells = std::min(cells * K, n / MinCellSize);
+    }
+    cells = std::max<size_t>(cells, 1);
+    this->capacity = (n + cells - 1) / cells;
 
-    return result;
+    Points work(points);
+    Point lo = mins;
+    for (size_t i=0; i<Dim; ++i) {
+        lo[i] -= 0.000001; // this is to resolve numerical issues
+    }
+    build_node(work, 0, n, lo, maxs);
 }
 
-Points knn_query(Point& point, size_t k) {
-    auto start = std::chrono::steady_clock::now();
+inline size_t size() const {
+    return volumes.size();
+}
 
-    Points range_result;
+inline size_t size_in_bytes() const {
+    return nodes.size() * (sizeof(Node) + 2 * sizeof(Point)) + cell_lo.size() * sizeof(Point) + volumes.size() * sizeof(double);
+}
 
-    // initialize search range
-    double r = initial_knn_range(point, k);
-    if (r == 0.0) {
-        r = this->min_width / (2.0 * K);
+inline size_t locate(const Point& p) const {
+    uint32_t node = 0;
+    while (nodes[node].dim != Leaf) {
+        node = (p[nodes[node].dim] < nodes[node].split) ? node + 1 : nodes[node].child;
     }
+    return nodes[node].child;
+}
 
-    while (1) {
-        knn_range_helper(range_result, point, r);
+inline double project(const Point& p, size_t cell) const {
+    return lisa_project<Dim>(p, cell_lo[cell], mins, maxs, cell, volumes[cell]);
+}
 
-        // k results found
-        if (range_result.size() >= k) {
-            break;
+// grow the extents of the nodes on the path of a point, after removes they still bound the points of each node
+inline void extend(const Point& p) {
+    uint32_t node = 0;
+    while (true) {
+        for (size_t i=0; i<Dim; ++i) {
+            node_mins[node][i] = std::min(node_mins[node][i], p[i]);
+            node_maxs[node][i] = std::max(node_maxs[node][i], p[i]);
         }
+        if (nodes[node].dim == Leaf) {
+            return;
+        }
+        node = (p[nodes[node].dim] < nodes[node].split) ? node + 1 : nodes[node].child;
+    }
+}
 
-        // increase the search range
-        r *= 2;
-        range_result.clear();
+// f(cell, mask) for every cell whose points may intersect the box, bit d of mask is set if dimension d cuts the cell
+template<typename F>
+inline void for_each_cell(Box& box, F f) {
+    thread_local std::vector<uint32_t> stack;
+    stack.clear();
+    stack.push_back(0);
+
+    while (!stack.empty()) {
+        uint32_t node = stack.back();
+        stack.pop_back();
+
+        uint32_t mask = 0;
+        bool disjoint = false;
+        for (size_t i=0; i<Dim && !disjoint; ++i) {
+            disjoint = node_maxs[node][i] < box.min_corner()[i] || node_mins[node][i] > box.max_corner()[i];
+            if (node_mins[node][i] < box.min_corner()[i] || node_maxs[node][i] > box.max_corner()[i]) {
+                mask |= (1u << i);
+            }
+        }
+        if (disjoint) {
+            continue;
+        }
+
+        if (nodes[node].dim == Leaf) {
+            f(nodes[node].child, mask);
+            continue;
+        }
+        // the left subtree is visited first, so the cells come in increasing order
+        stack.push_back(nodes[node].child);
+        stack.push_back(node + 1);
     }
+}
 
-    auto end = std::chrono::steady_clock::now();
-    knn_time += std::chrono::duration_cast<std::chrono::microseconds>(end - start).count();
-    knn_count ++;
+// visit(cell, min_dist_square) in increasing min_dist_square until it returns false
+template<typename F>
+inline void nearest_cells(Point& q, F visit) {
+    auto min_dist_square = [this, &q](uint32_t node) {
+        double acc = 0.0;
+        for (size_t i=0; i<Dim; ++i) {
+            double lo = node_mins[node][i], hi = node_maxs[node][i];
+            double delta = (q[i] < lo) ? (lo - q[i]) : ((q[i] > hi) ? (q[i] - hi) : 0.0);
+            acc += delta * delta;
+        }
+        return acc;
+    };
+
+    using Entry = std::pair<double, uint32_t>;
+    std::priority_queue<Entry, std::vector<Entry>, std::greater<Entry>> queue;
+    queue.emplace(min_dist_square(0), 0);
+    while (!queue.empty()) {
+        auto [dist_square, node] = queue.top();
+        queue.pop();
+
+        if (nodes[node].dim == Leaf) {
+            if (!visit(nodes[node].child, dist_square)) {
+                return;
+            }
+            continue;
+        }
+        queue.emplace(min_dist_square(node + 1), node + 1);
+        queue.emplace(min_dist_square(nodes[node].child), nodes[node].child);
+    }
+}
 
-    std::sort(range_result.begin(), range_result.end(), 
-        [&](auto& p1, auto p2) { 
-            return bench::common::eu_dist_square(p1, point) < bench::common::eu_dist_square(p2, point); 
-        });
+private:
+// the maximum number of points of a cell unless they share their coordinates
+size_t capacity;
+
+std::vector<Node> nodes;
+// extent of the points of each node
+Points node_mins;
+Points node_maxs;
+
+// the lower corner and the volume of each cell, fixed at build time since the keys depend on them
+Points cell_lo;
+std::vector<double> volumes;
+
+Point mins;
+Point maxs;
+
+// build the subtree of the points in [lo, hi) within the region [region_lo, region_hi], returns its root
+uint32_t build_node(Points& points, size_t lo, size_t hi, Point region_lo, Point region_hi) {
+    uint32_t node = static_cast<uint32_t>(nodes.size());
+    nodes.push_back({0.0, Leaf, 0});
+
+    Point ext_min, ext_max;
+    ext_min.fill(std::numeric_limits<double>::infinity());
+    ext_max.fill(-std::numeric_limits<double>::infinity());
+    for (size_t j=lo; j<hi; ++j) {
+        for (size_t i=0; i<Dim; ++i) {
+            ext_min[i] = std::min(ext_min[i], points[j][i]);
+            ext_max[i] = std::max(ext_max[i], points[j][i]);
+        }
+    }
+    node_mins.push_back(ext_min);
+    node_maxs.push_back(ext_max);
 
-    Points knn_result(range_result.begin(), range_result.begin()+k);
+    // split on the dimension of the widest spread relative to the data
+    size_t dim = Dim;
+    double widest = 0.0;
+    for (size_t i=0; i<Dim; ++i) {
+        double spread = (maxs[i] > mins[i]) ? (ext_max[i] - ext_min[i]) / (maxs[i] - mins[i]) : 0.0;
+        if (spread > widest) {
+            widest = spread;
+            dim = i;
+        }
+    }
 
-    return knn_result;
+    if (hi - lo <= capacity || dim == Dim) {
+        nodes[node].child = static_cast<uint32_t>(volumes.size());
+        double volume = 10.0;
+        for (size_t i=0; i<Dim; ++i) {
+            volume *= (100 * (region_hi[i] - region_lo[i]));
+        }
+        cell_lo.push_back(region_lo);
+        volumes.push_back(volume);
+        return node;
+    }
+
+    // split at the median, a median equal to the minimum moves the split above its run of duplicates
+    auto by_dim = [dim](const Point& a, const Point& b) { return a[dim] < b[dim]; };
+    size_t mid = lo + (hi - lo) / 2;
+    std::nth_element(points.begin() + lo, points.begin() + mid, points.begin() + hi, by_dim);
+    double split = points[mid][dim];
+    auto middle = std::partition(points.begin() + lo, points.begin() + hi, [dim, split](const Point& p) { return p[dim] < split; });
+    if (middle == points.begin() + lo) {
+        middle = std::partition(points.begin() + lo, points.begin() + hi, [dim, split](const Point& p) { return p[dim] <= split; });
+        split = (*std::min_element(middle, points.begin() + hi, by_dim))[dim];
+    }
+    size_t cut = middle - points.begin();
+
+    nodes[node].split = split;
+    nodes[node].dim = static_cast<uint32_t>(dim);
+
+    Point left_hi = region_hi, right_lo = region_lo;
+    left_hi[dim] = split;
+    right_lo[dim] = split;
+    build_node(points, lo, cut, region_lo, left_hi);
+    uint32_t right = build_node(points, cut, hi, right_lo, region_hi);
+    nodes[node].child = right;
+    return node;
 }
 
+};
 
-private:
-// dimension offsets in bucket array
-std::array<size_t, Dim> dim_offset;
 
-// bucket boundaries on each dimension
-Partitions partitions; 
+// Cells is the cell layout, the equal-depth grid of the original LISA or kd-tree leaves adapted to the data
+// Epsilon bounds the error of the local shard models, a shard is retrained after MaxUpdates inserts and deletes
+template<size_t Dim, size_t K, size_t Epsilon=64, template<size_t, size_t> class Cells=EqualDepthCells, size_t MaxUpdates=64>
+class LISA2 : public BaseIndex {
 
-// min corner
-std::array<double, Dim> mins;
+using Point = point_t<Dim>;
+using Box = box_t<Dim>;
+using Points = std::vector<Point>;
 
-// max corner
-std::array<double, Dim> maxs;
+// a segment of a shard model, positions are relative to the first point of the shard
+struct ShardSegment {
+    double key;
+    double slope;
+    int64_t intercept;
+};
 
-// minimum width
-double min_width;
+// a shard holds the points of one cell ordered by projection, and a local piecewise linear model
+// maps projections to positions in the shard within Epsilon
+// every insert or delete moves a point by at most one position, so lookups search a window of
+// Epsilon + updates around the prediction
+struct Shard {
+    std::vector<double> keys;
+    Points points;
+    std::vector<ShardSegment> segments;
+    uint32_t updates;
+};
 
-// pre-computed grid volumes
-std::array<double, bench::common::ipow(K, Dim)> volumes;
+static constexpr uint32_t NoShard = std::numeric_limits<uint32_t>::max();
 
-// points ordered by projection function
-Points _data;
+public:
 
-// ptr to the underlying 1-d learned index
-PGMIdx* _pgm_ptr;
+LISA2(Points& points) {
+    std::cout << "Construct LISA " << "K=" << K << " Epsilon=" << Epsilon << " MaxUpdates=" << MaxUpdates
+              << " Cells=" << Cells<Dim, K>::name << std::endl;
 
-// find intitial search range
-inline double initial_knn_range(Point& q, size_t k) {
-    double min_r = std::numeric_limits<double>::max();
+    auto start = std::chrono::steady_clock::now();
+    cells.build(points);
+
+    // group the points by cell, only non-empty cells get a shard
+    const size_t n = points.size();
+    std::vector<size_t> cell_of(n);
+    bench::common::parallel_for(n, [&](size_t lo, size_t hi) {
+        for (size_t i=lo; i<hi; ++i) {
+            cell_of[i] = cells.locate(points[i]);
+        }
+    });
 
-    for (size_t i=0; i<Dim; ++i) {
-        auto idx = get_dim_idx(q, i);
-        if (idx == K-1) {
-            min_r = std::min(min_r, (this->maxs[i] - q[i]));
-            min_r = std::min(min_r, (q[i] - this->partitions[i][idx]));
-        } else {
-            min_r = std::min(min_r, (this->partitions[i][idx+1] - q[i]));
-            min_r = std::min(min_r, (q[i] - this->partitions[i][idx]));
+    std::vector<size_t> cell_count(cells.size(), 0);
+    for (auto c : cell_of) {
+        cell_count[c]++;
+    }
+    this->shard_of.assign(cells.size(), NoShard);
+    for (size_t c=0; c<cells.size(); ++c) {
+        if (cell_count[c] > 0) {
+            shard_of[c] = static_cast<uint32_t>(shards.size());
+            shards.emplace_back();
+            shards.back().points.reserve(cell_count[c]);
         }
     }
+    for (size_t i=0; i<n; ++i) {
+        shards[shard_of[cell_of[i]]].points.emplace_back(points[i]);
+    }
+    this->n_points = n;
 
-    return min_r;
-}
+    // sort every shard by projection and train its local model, shards are independent
+    bench::common::parallel_tasks(shards.size(), [this](size_t s) {
+        auto& shard = shards[s];
+        size_t cell = cells.locate(shard.points.front());
 
-void knn_range_helper(Points& result_found, Point& q, double r) {
-    Point min_p = q;
-    Point max_p = q;
-    for (size_t i=0; i<Dim; ++i) {
-        min_p[i] -= r;
-        max_p[i] += r;
-    }
-    Box qbox(min_p, max_p);
+        std::vector<std::pair<double, size_t>> keyed(shard.points.size());
+        for (size_t i=0; i<keyed.size(); ++i) {
+            keyed[i] = std::make_pair(cells.project(shard.points[i], cell), i);
+        }
+        std::sort(keyed.begin(), keyed.end());
+
+        Points sorted_points(keyed.size());
+        shard.keys.resize(keyed.size());
+        for (size_t i=0; i<keyed.size(); ++i) {
+            sorted_points[i] = shard.points[keyed[i].second];
+            shard.keys[i] = keyed[i].first;
+        }
+        shard.points.swap(sorted_points);
+        train(shard);
+    });
+    std::cout << "Cells: " << cells.size() << " Shards: " << shards.size() << std::endl;
 
-    std::vector<std::pair<size_t, size_t>> ranges;
-    find_intersect_ranges(ranges, qbox);
+    auto end = std::chrono::steady_clock::now();
+    build_time = std::chrono::duration_cast<std::chrono::milliseconds>(end - start).count();
+    std::cout << "Build Time: " << get_build_time() << " [ms]" << std::endl;
+    std::cout << "Index Size: " << index_size() << " Bytes" << std::endl;
+}
+
+inline size_t count() {
+    return this->n_points;
+}
 
-    for (const auto& range : ranges) {
-        search_range(result_found, static_cast<double>(std::get<0>(range)), static_cast<double>(std::get<1>(range)+1), qbox);
+inline size_t index_size() {
+    // the cell layout, the cell-to-shard table, the shard models and the projections of the points
+    size_t shard_size = this->shard_of.size() * sizeof(uint32_t) + this->shards.size() * sizeof(uint32_t);
+    for (const auto& shard : this->shards) {
+        shard_size += shard.segments.size() * sizeof(ShardSegment) + shard.keys.size() * sizeof(double);
     }
+    return cells.size_in_bytes() + shard_size + count() * sizeof(size_t);
 }
 
-// lo and hi are projected values
-inline void search_range(Points& result, double lo, double hi, Box& qbox) {
-    auto range_lo = this->_pgm_ptr->search(lo);
-    auto range_hi = this->_pgm_ptr->search(hi);
+Points range_query(Box& box) {
+    auto start = std::chrono::steady_clock::now();
 
-    for (size_t i=range_lo.lo; i<range_hi.hi; ++i) {
-        if (bench::common::is_in_box(this->_data[i], qbox)) {
-            result.emplace_back(this->_data[i]);
+    // the non-empty cells intersected by the box and the dimensions that cut them
+    thread_local std::vector<std::pair<size_t, uint32_t>> hits;
+    hits.clear();
+    cells.for_each_cell(box, [this](size_t cell, uint32_t mask) {
+        if (shard_of[cell] != NoShard) {
+            hits.emplace_back(cell, mask);
         }
+    });
+
+    // the points of the intersected cells bound the result size
+    Points result;
+    size_t candidates = 0;
+    for (auto& hit : hits) {
+        candidates += shards[shard_of[hit.first]].points.size();
+    }
+    result.reserve(candidates);
+
+    // shards of cells covered by the box are copied as a whole, the others are searched with their local models
+    // and refined on the dimensions that cut them
+    for (auto& hit : hits) {
+        search_shard(result, box, hit.first, hit.second);
     }
 
-    // auto it_lo = this->_data.begin() + range_lo.lo;
-    // auto it_hi = this->_data.begin() + range_hi.hi;
+    auto end = std::chrono::steady_clock::now();
+    range_time += std::chrono::duration_cast<std::chrono::microseconds>(end - start).count();
+    range_count ++;
 
-    // for (auto it=it_lo; it!=it_hi; ++it) {
-    //     if (bench::common::is_in_box(*it, qbox)) {
-    //         result.emplace_back(*it);
-    //     }
-    // }
+    return result;
 }
 
-inline void find_intersect_ranges(std::vector<std::pair<size_t, size_t>>& ranges, Box& qbox) {
-    // search range on the 1-st dimension
-    ranges.emplace_back(get_dim_idx(qbox.min_corner(), 0), get_dim_idx(qbox.max_corner(), 0));
-    
-    // find all intersect ranges
-    for (size_t i=1; i<Dim; ++i) {
-        auto start_idx = get_dim_idx(qbox.min_corner(), i);
-        auto end_idx = get_dim_idx(qbox.max_corner(), i);
+// best-first knn search over cells
+// cells are scanned in increasing distance from the query until the next cell is farther than the k-th point found
+Points knn_query(Point& point, size_t k) {
+    auto start = std::chrono::steady_clock::now();
 
-        std::vector<std::pair<size_t, size_t>> temp_ranges;
-        for (auto idx=start_idx; idx<=end_idx; ++idx) {
-            for (size_t j=0; j<ranges.size(); ++j) {
-                temp_ranges.emplace_back(ranges[j].first + idx*dim_offset[i], ranges[j].second + idx*dim_offset[i]);
+    // the k closest points found so far, a max-heap on squared distance
+    std::priority_queue<std::pair<double, const Point*>> knn;
+
+    if (k > 0) {
+        cells.nearest_cells(point, [&](size_t cell_id, double min_dist_square) {
+            if (knn.size() == k && min_dist_square >= knn.top().first) {
+                return false;
             }
-        }
+            scan_cell(knn, point, k, cell_id);
+            return true;
+        });
+    }
+
+    auto end = std::chrono::steady_clock::now();
+    knn_time += std::chrono::duration_cast<std::chrono::microseconds>(end - start).count();
+    knn_count ++;
+
+    Points knn_result(knn.size());
+    for (size_t i=knn.size(); i-- > 0; ) {
+        knn_result[i] = *knn.top().second;
+        knn.pop();
+    }
+
+    return knn_result;
+}
+
+// insert a point into the shard of its cell, the shard is retrained once its model has absorbed MaxUpdates updates
+void insert(Point& point) {
+    auto start = std::chrono::steady_clock::now();
+
+    auto cell = cells.locate(point);
+    if (shard_of[cell] == NoShard) {
+        shard_of[cell] = static_cast<uint32_t>(shards.size());
+        shards.emplace_back();
+        train(shards.back());
+    }
 
-        // update the range vector
-        ranges = temp_ranges;
+    auto& shard = shards[shard_of[cell]];
+    double key = cells.project(point, cell);
+    size_t pos = shard_lower_bound(shard, key);
+    cells.extend(point);
+    shard.keys.insert(shard.keys.begin() + pos, key);
+    shard.points.insert(shard.points.begin() + pos, point);
+    if (++shard.updates > MaxUpdates) {
+        train(shard);
     }
+    n_points ++;
+
+    auto end = std::chrono::steady_clock::now();
+    insert_time += std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count();
+    insert_count ++;
 }
 
-inline double project(Point& point) {
-    size_t id = compute_id(point);
-    double vol = 10.0;
-    
-    for (size_t i=0; i<Dim; ++i) {
-        auto current_idx = get_dim_idx(point, i);
-        
-        if (point[i] <= this->mins[i]) {
-            vol = 0.0;
-        } else if (point[i] >= this->maxs[i]) {
-            vol *= (100 * (this->maxs[i] - partitions[i][current_idx]));
-        } else {
-            vol *= (100 * (point[i] - partitions[i][current_idx]));
+// remove one copy of a point, returns false if the point is not indexed
+bool remove(Point& point) {
+    auto start = std::chrono::steady_clock::now();
+
+    bool found = false;
+    auto cell = cells.locate(point);
+    if (shard_of[cell] != NoShard) {
+        auto& shard = shards[shard_of[cell]];
+        double key = cells.project(point, cell);
+        for (size_t i=shard_lower_bound(shard, key); i<shard.keys.size() && shard.keys[i] == key; ++i) {
+            if (shard.points[i] == point) {
+                shard.keys.erase(shard.keys.begin() + i);
+                shard.points.erase(shard.points.begin() + i);
+                if (++shard.updates > MaxUpdates) {
+                    train(shard);
+                }
+                n_points --;
+                found = true;
+                break;
+            }
         }
     }
 
-    return static_cast<double>(id) + vol / this->volumes[id];
+    auto end = std::chrono::steady_clock::now();
+    remove_time += std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count();
+    remove_count ++;
+
+    return found;
 }
 
-inline size_t get_dim_idx(Point& p, size_t d) {
-    if (p[d] <= partitions[d][0]) {
-        return 0;
-    } else {
-        auto upper = std::upper_bound(partitions[d].begin(), partitions[d].end(), p[d]);
-        return (size_t) (upper - partitions[d].begin() - 1);
+
+private:
+Cells<Dim, K> cells;
+
+// the shard of each cell, NoShard for cells that have never held a point
+std::vector<uint32_t> shard_of;
+std::vector<Shard> shards;
+
+size_t n_points;
+
+// update the knn heap with the points of a cell
+inline void scan_cell(std::priority_queue<std::pair<double, const Point*>>& knn, Point& q, size_t k, size_t cell_id) {
+    if (shard_of[cell_id] == NoShard) {
+        return;
+    }
+    for (auto& p : shards[shard_of[cell_id]].points) {
+        double d = bench::common::eu_dist_square(p, q);
+        if (knn.size() < k) {
+            knn.emplace(d, &p);
+        } else if (d < knn.top().first) {
+            knn.pop();
+            knn.emplace(d, &p);
+        }
     }
 }
 
-inline size_t compute_id(Point& p) {
-    size_t id = 0;
+// search the shard of a cell that is cut by the box on the dimensions in mask
+// the projections of the points of a cell in the box lie between the projections of the box corners,
+// since the projection within a cell is monotone on every dimension
+inline void search_shard(Points& result, Box& box, size_t cell, uint32_t mask) {
+    auto& shard = shards[shard_of[cell]];
+    if (mask == 0) {
+        result.insert(result.end(), shard.points.begin(), shard.points.end());
+        return;
+    }
 
-    for (size_t i=0; i<Dim; ++i) {
-        auto current_idx = get_dim_idx(p, i);
-        id += current_idx * dim_offset[i];
+    double lo_key = cells.project(box.min_corner(), cell);
+    double hi_key = cells.project(box.max_corner(), cell);
+
+    for (size_t i=shard_lower_bound(shard, lo_key); i<shard.keys.size() && shard.keys[i] <= hi_key; ++i) {
+        if (bench::common::is_in_box_on(shard.points[i], box, mask)) {
+            result.emplace_back(shard.points[i]);
+        }
     }
+}
 
-    return id;
+// fit the piecewise linear model of a shard with error Epsilon
+// duplicate keys are skipped, a run of equal keys is mapped to its first position
+inline void train(Shard& shard) {
+    shard.segments.clear();
+    shard.updates = 0;
+    auto in_fun = [&shard](size_t i) { return std::pair<double, size_t>(shard.keys[i], i); };
+    auto out_fun = [&shard](const auto& cs) {
+        auto [slope, intercept] = cs.get_floating_point_segment(cs.get_first_x());
+        shard.segments.push_back({cs.get_first_x(), static_cast<double>(slope), static_cast<int64_t>(intercept)});
+    };
+    pgm::internal::make_segmentation(shard.keys.size(), Epsilon, in_fun, out_fun);
 }
 
-inline size_t compute_id(std::array<size_t, Dim>& idx_comb) {
-    size_t id = 0;
-    for (size_t i=0; i<Dim; ++i) {
-        id += idx_comb[i] * dim_offset[i];
+// the approximate position of key in a shard
+inline size_t shard_predict(const Shard& shard, double key) {
+    const auto& segs = shard.segments;
+    auto it = pgm::branchless_upper_bound(segs.begin(), segs.end(), key,
+        [](double k, const ShardSegment& seg) { return k < seg.key; });
+    if (it == segs.begin()) {
+        return 0;
     }
-    return id;
+    --it;
+    int64_t pos = static_cast<int64_t>(it->slope * (key - it->key)) + it->intercept;
+    int64_t cap = (it + 1 < segs.end()) ? (it + 1)->intercept : static_cast<int64_t>(shard.keys.size());
+    return static_cast<size_t>(std::clamp<int64_t>(pos, 0, cap));
+}
+
+// the first position in a shard whose key is not less than key
+// the error bound only holds for the indexed keys, so the window is checked
+// and the whole shard is searched if it does not contain the result
+inline size_t shard_lower_bound(const Shard& shard, double key) {
+    const size_t n = shard.keys.size();
+    size_t pos = shard_predict(shard, key);
+    size_t radius = Epsilon + 1 + shard.updates;
+    size_t lo = (pos > radius) ? pos - radius : 0;
+    size_t hi = std::min(n, pos + radius + 1);
+    if ((lo > 0 && shard.keys[lo - 1] >= key) || (hi < n && shard.keys[hi] < key)) {
+        lo = 0;
+        hi = n;
+    }
+    return std::lower_bound(shard.keys.begin() + lo, shard.keys.begin() + hi, key) - shard.keys.begin();
 }
 
 };
@@ -2,43 +2,112 @@
 
 #include "dkm.hpp"
 #include "../../utils/common.hpp"
+#include "../../utils/parallel.hpp"
 #include "../../utils/type.hpp"
 #include "../base_index.hpp"
 #include "../pgm/pgm_index.hpp"
 
+#include <algorithm>
 #include <cstddef>
 #include <cstdint>
+#include <functional>
 #include <tuple>
 #include <utility>
 #include <vector>
 #include <chrono>
 #include <queue>
 #include <cmath>
+#include <random>
+#include <string>
 
 namespace bench { namespace index {
 
+// k-means policies used to find the reference points of ML-Index
+// each policy clusters the points into k partitions with a fixed random seed for reproduction
+// and returns the means and the partition of every point
+
+// the original single-threaded Lloyd's algorithm with 20 iterations
+struct LloydKMeans {
+    static constexpr const char* name = "lloyd";
+
+    template<typename Points>
+    static auto cluster(const Points& points, uint32_t k) {
+        dkm::clustering_parameters<double> config(k);
+        config.set_random_seed(0);
+        config.set_max_iteration(20);
+        return dkm::kmeans_lloyd(points, config);
+    }
+};
+
+// Lloyd's algorithm with 20 iterations on the build threads
+struct ParallelLloydKMeans {
+    static constexpr const char* name = "parallel-lloyd";
+
+    template<typename Points>
+    static auto cluster(const Points& points, uint32_t k) {
+        dkm::clustering_parameters<double> config(k);
+        config.set_random_seed(0);
+        config.set_max_iteration(20);
+        return dkm::kmeans_lloyd_parallel(points, config);
+    }
+};
+
+// mini-batch k-means followed by a full assignment pass
+template<size_t BatchSize=4096, size_t Iterations=100>
+struct MiniBatchKMeans {
+    static constexpr const char* name = "mini-batch";
+
+    template<typename Points>
+    static auto cluster(const Points& points, uint32_t k) {
+        dkm::clustering_parameters<double> config(k);
+        config.set_random_seed(0);
+        config.set_max_iteration(Iterations);
+        return dkm::kmeans_minibatch(points, config, BatchSize);
+    }
+};
+
+
 // eps is the error bound for the underlying 1-D learned index
-// p is the partition number (input of the kmeans algorithm)
-template<size_t dim, size_t eps=64, size_t p=50>
+// KMeans is the k-means policy used to partition the points
+template<size_t dim, size_t eps=64, typename KMeans=ParallelLloydKMeans>
 class MLIndex : public BaseIndex {
 
 using Point = point_t<dim>;
 using Box = box_t<dim>;
 using Points = std::vector<point_t<dim>>;
 
+// the cost model of a range query, in units of one key scanned:
+// searching a partition costs a PGM lookup at both ends of its annulus plus the scan of the two error windows,
+// and every center costs a (vectorized) box distance
+static constexpr double partition_cost = 64.0 + 2.0 * eps;
+static constexpr double centre_cost = 0.25;
+
+// the partition number is tuned on a sample of the points
+static constexpr size_t tuning_sample_size = 1 << 15;
+static constexpr size_t min_tuning_partitions = 16;
+// each sampled partition keeps at least this many points, so that its annuli are estimated reliably
+static constexpr size_t min_tuning_partition_size = 16;
+
 public:
-MLIndex(Points& points) {
-    std::cout << "Construct ML-Index: " << "partition=" << p << " eps=" << eps << std::endl;
+// partitions is the partition number (input of the kmeans algorithm)
+// with partitions=0 it is chosen by a cost model search on the points and the workload,
+// a sample of range queries (queries of 1% selectivity around random points if empty)
+MLIndex(Points& points, size_t partitions=0, const std::vector<Box>& workload={}) {
+    std::cout << "Construct ML-Index: " << "partition=" << (partitions == 0 ? "auto" : std::to_string(partitions))
+              << " eps=" << eps << " kmeans=" << KMeans::name << std::endl;
 
     auto start = std::chrono::steady_clock::now();
 
-    // call k-means with fixed random seed
-    dkm::clustering_parameters<double> config(p);
-    // fix the random seed for reproduction
-    config.set_random_seed(0);
-    config.set_max_iteration(20);
+    if (partitions == 0) {
+        partitions = tune_partitions(points, workload);
+    }
+    this->p = std::max<size_t>(1, std::min(partitions, points.size()));
+    this->radii.resize(p);
+    this->offsets.resize(p);
+    this->part_begin.resize(p + 1);
+
     // find kmeans clusters
-    auto clusters = dkm::kmeans_lloyd(points, config); 
+    auto clusters = KMeans::cluster(points, p); 
     
     // fill means vector
     means.reserve(p);
@@ -46,12 +115,19 @@ MLIndex(Points& points) {
         means.emplace_back(mean);
     }
 
+    // assign every point to its closest center
+    // the labels of the last k-means iteration may be stale w.r.t. the final means
+    std::vector<std::pair<size_t, double>> point_assignments(points.size());
+    bench::common::parallel_for(points.size(), [&](size_t lo, size_t hi) {
+        for (size_t i=lo; i<hi; ++i) {
+            point_assignments[i] = assign(points[i]);
+        }
+    });
+
     // fill radii vector
     std::fill(this->radii.begin(), this->radii.end(), 0.0);
 
-    for (size_t i=0; i<points.size(); ++i) {
-        auto pid = std::get<1>(clusters)[i];
-        auto dist = bench::common::eu_dist(means[pid], points[i]);
+    for (auto [pid, dist] : point_assignments) {
         radii[pid] = std::max(radii[pid], dist);
     }
 
@@ -66,28 +142,36 @@ MLIndex(Points& points) {
         offsets[i] += offsets[i-1];
     }
 
-    // construct learned index on projected values
-    std::vector<std::pair<Point, double>> point_with_projection;
-    std::vector<double> projections;
-
-    point_with_projection.reserve(points.size());
-    projections.reserve(points.size());
-    this->_data.reserve(points.size());
+    build_centre_list();
 
-    for (auto& point : points) {
-        point_with_projection.emplace_back(point, project(point));
+    // construct learned index on projected values
+    // points are sorted by (partition, distance to center), which is also the order of projected values
+    // and makes each partition a contiguous range of positions
+    auto order = bench::common::sort_by_key<std::pair<size_t, double>>(points, 
+        [&](Point& point) { return point_assignments[&point - points.data()]; });
+    std::vector<std::pair<size_t, double>> assignments;
+    bench::common::gather(points, order, this->_data, assignments);
+
+    std::vector<double> projections(assignments.size());
+    std::fill(part_begin.begin(), part_begin.end(), assignments.size());
+    for (size_t i=assignments.size(); i-- > 0; ) {
+        auto [pid, dist] = assignments[i];
+        projections[i] = offsets[pid] + dist;
+        part_begin[pid] = i;
+    }
+    // empty partitions start where the next partition starts
+    for (size_t i=p; i-- > 0; ) {
+        part_begin[i] = std::min(part_begin[i], part_begin[i+1]);
     }
 
-    std::sort(point_with_projection.begin(), point_with_projection.end(), 
-        [](auto p1, auto p2) { 
-            return std::get<1>(p1) < std::get<1>(p2); 
-        });
-
-    for (auto& pp : point_with_projection) {
-        this->_data.emplace_back(std::get<0>(pp));
-        projections.emplace_back(std::get<1>(pp));
+    // make sure there is no duplicate keys, e.g., duplicate points or consecutive single-point partitions
+    // keys are only moved up by a few ulps, the searches re-check the true distances at the upper end
+    for (size_t i=1; i<projections.size(); ++i) {
+        if (projections[i] <= projections[i-1]) {
+            projections[i] = std::nextafter(projections[i-1], std::numeric_limits<double>::infinity());
+        }
     }
-    
+
     this->_pgm = new pgm::PGMIndex<double, eps>(projections);
 
     auto end = std::chrono::steady_clock::now();
@@ -106,9 +190,11 @@ inline size_t count() {
 }
 
 inline size_t index_size() {
-    return p * (2*sizeof(double) + sizeof(Point)) + _pgm->size_in_bytes() + count() * sizeof(size_t);
+    return p * (2*sizeof(double) + sizeof(Point)) + _pgm->size_in_bytes() + count() * sizeof(size_t)
+        + p * (sizeof(size_t) + sizeof(double) + sizeof(Point)) + (p+1) * sizeof(size_t);
 }
 
+// every partition is searched on the annulus between the min and max distances from its center to the box
 Points range_query(Box& box) {
     auto start = std::chrono::steady_clock::now();
 
@@ -121,15 +207,25 @@ Points range_query(Box& box) {
     }
     double radius = bench::common::eu_dist(min_corner, max_corner) / 2.0;
 
-    Points candidates;
+    // candidate partitions are those within reach of the circumscribing ball in the pivot order
+    double q_pivot_dist = bench::common::eu_dist(center, this->pivot);
+    double reach = (radius + max_radius) * (1 + 1e-12);
+    auto lo = std::lower_bound(pivot_dists.begin(), pivot_dists.end(), q_pivot_dist - reach) - pivot_dists.begin();
+    auto hi = std::upper_bound(pivot_dists.begin(), pivot_dists.end(), q_pivot_dist + reach) - pivot_dists.begin();
 
-    dist_search(candidates, center, radius);
+    std::vector<double> min_dists(p), max_dists(p);
+    box_dists(box, lo, hi, min_dists.data(), max_dists.data());
 
     Points results;
-    for (auto& cand : candidates) {
-        if (bench::common::is_in_box(cand, box)) {
-            results.emplace_back(cand);
+    // the annulus is widened by a relative 1e-12 since eu_dist and box_dists may round differently,
+    // the same tolerance keeps a partition whose radius ties with its distance to the box
+    for (auto j=lo; j<hi; ++j) {
+        auto partition_id = pivot_order[j];
+        if (min_dists[j] * (1 - 1e-12) > radii[partition_id]) {
+            continue;
         }
+        annulus_search(results, box, partition_id, min_dists[j] * (1 - 1e-12), 
+            std::min(max_dists[j] * (1 + 1e-12), radii[partition_id]));
     }
 
     auto end = std::chrono::steady_clock::now();
@@ -139,123 +235,222 @@ Points range_query(Box& box) {
     return results;
 }
 
-Points knn_query(Point& point, size_t k) {
-    auto start = std::chrono::steady_clock::now();
-
-    // initial search distance
-    size_t p_id = find_closest_center(point);
-    double r = this->radii[p_id] * std::pow((p * k)/(count() * 1.0), 1.0/dim);
+// search the points of a partition whose distances to the center are in [t_lo, t_hi]
+// the scan is clamped to the positions of the partition, so points are never reported twice
+inline void annulus_search(Points& results, Box& box, size_t partition_id, double t_lo, double t_hi) {
+    size_t first = part_begin[partition_id];
+    size_t last = part_begin[partition_id+1];
 
-    Points temp_result;
-    while (1) {
-        dist_search(temp_result, point, r);
+    auto range_lo = this->_pgm->search(offsets[partition_id] + t_lo);
+    auto range_hi = this->_pgm->search(offsets[partition_id] + t_hi);
+    size_t from = std::max(first, range_lo.lo);
+    size_t to = std::max(from, std::min(last, range_hi.hi));
 
-        // k results found
-        if (temp_result.size() >= k) {
-            break;
+    for (size_t i=from; i<to; ++i) {
+        if (bench::common::is_in_box(_data[i], box)) {
+            results.emplace_back(_data[i]);
         }
+    }
 
-        r *= 2;
-        temp_result.clear();
+    // a run of keys equal to the upper key may extend past the error window
+    for (size_t i=to; i<last && bench::common::eu_dist(_data[i], means[partition_id]) <= t_hi; ++i) {
+        if (bench::common::is_in_box(_data[i], box)) {
+            results.emplace_back(_data[i]);
+        }
     }
+}
 
-    auto end = std::chrono::steady_clock::now();
-    knn_time += std::chrono::duration_cast<std::chrono::microseconds>(end - start).count();
-    knn_count ++;
+// incremental knn search
+// every partition is scanned by two cursors moving outward from the position of the query distance to its center,
+// points at distance t from the center of partition i are at least |d(q, c_i) - t| away from q,
+// so cursors are advanced in order of this lower bound until it exceeds the k-th distance found
+Points knn_query(Point& point, size_t k) {
+    auto start = std::chrono::steady_clock::now();
 
-    std::sort(temp_result.begin(), temp_result.end(), 
-        [&](auto& p1, auto p2) { 
-            return bench::common::eu_dist_square(p1, point) < bench::common::eu_dist_square(p2, point); 
-        });
-    
-    Points result(temp_result.begin(), temp_result.begin()+k);
-    return result;
-}
+    // distances from the query to every center, by partition id
+    std::vector<double> pivot_ordered_dists(p);
+    std::vector<double> centre_dist(p);
+    centre_dists(point, 0, p, pivot_ordered_dists.data());
+    for (size_t j=0; j<p; ++j) {
+        centre_dist[pivot_order[j]] = pivot_ordered_dists[j];
+    }
 
-// search points in a circle cenerted at q_point with radius=dist
-inline void dist_search(Points& results, Point& q_point, double dist) {
-    assert(dist > 0);
+    // a cursor with dir=0 is a partition that is not opened yet
+    struct Cursor {
+        double bound;
+        size_t partition_id;
+        size_t pos;
+        int dir;
 
-    // search each partition
+        bool operator>(const Cursor& other) const { return bound > other.bound; }
+    };
+    std::priority_queue<Cursor, std::vector<Cursor>, std::greater<Cursor>> cursors;
     for (size_t i=0; i<p; ++i) {
-        partition_search(results, q_point, dist, i);
+        if (k > 0 && part_begin[i] < part_begin[i+1]) {
+            cursors.push({std::max(0.0, centre_dist[i] - radii[i]), i, 0, 0});
+        }
     }
-}
 
-// map a distance range query to 1-D intervals on each partition
-inline void partition_search(Points& results, Point& q_point, double radius, size_t partition_id) {
-    double partition_radius = this->radii[partition_id];
-    double dist_to_center = bench::common::eu_dist(q_point, this->means[partition_id]);
+    // the k closest points found so far, a max-heap on distance
+    std::priority_queue<std::pair<double, size_t>> knn;
 
-    double lo=0.0, hi=0.0;
-    
-    if (dist_to_center < (radius + partition_radius) && dist_to_center > std::fabs(radius - partition_radius)) {
-        if (dist_to_center < radius) {
-            // case 1: two circle intersect and data center is in the search circle
-            lo = this->offsets[partition_id];
-            hi = this->offsets[partition_id] + this->radii[partition_id];
-        } else if (dist_to_center < partition_radius) {
-            // case 2: two circle intersect and search center is in the data partition
-            lo = this->offsets[partition_id] + (dist_to_center - radius);
-            hi = this->offsets[partition_id] + this->radii[partition_id];
-        } else {
-            // case 3: two circle intersect and no center is in another partition
-            lo = this->offsets[partition_id] + (dist_to_center - radius);
-            hi = this->offsets[partition_id] + this->radii[partition_id];
+    auto push_cursor = [&](size_t pid, size_t pos, int dir) {
+        if (pos < part_begin[pid] || pos >= part_begin[pid+1]) {
+            return;
         }
-    }
+        double t = bench::common::eu_dist(_data[pos], means[pid]);
+        double bound = (dir > 0) ? (t - centre_dist[pid]) : (centre_dist[pid] - t);
+        cursors.push({std::max(0.0, bound), pid, pos, dir});
+    };
 
-    if (dist_to_center < (partition_radius - radius)) {
-        // case 4: data partition covers the search circle
-        lo = this->offsets[partition_id] + (dist_to_center - radius);
-        hi = this->offsets[partition_id] + (dist_to_center + radius);
-    }
+    while (!cursors.empty()) {
+        auto c = cursors.top();
+        cursors.pop();
 
-    if (dist_to_center < (radius - partition_radius)) {
-        // case 5: search circle covers the data partition
-        lo = this->offsets[partition_id];
-        hi = this->offsets[partition_id] + this->radii[partition_id];
-    }
+        if (knn.size() == k && c.bound >= knn.top().first) {
+            break;
+        }
 
-    if (dist_to_center > (partition_radius + radius)) {
-        // case 6: two circles are disjoint and nothing to do
-        return;
-    }
-    
-    // query the index
-    assert(hi > lo);
-    double radius_square = radius * radius;
-    auto range_lo = this->_pgm->search(lo);
-    auto range_hi = this->_pgm->search(hi);
-    auto it_lo = _data.begin() + range_lo.lo;
-    auto it_hi = _data.begin() + range_hi.hi;
-
-    for (auto it=it_lo; it!=it_hi; ++it) {
-        // validate whether the result is within the given distance threshold radius
-        if (bench::common::eu_dist_square(*it, q_point) < radius_square) {
-            results.emplace_back(*it);
+        if (c.dir == 0) {
+            // open the partition at the position predicted for the query distance
+            double t = std::min(centre_dist[c.partition_id], radii[c.partition_id]);
+            size_t pos = _pgm->search(offsets[c.partition_id] + t).pos;
+            pos = std::clamp(pos, part_begin[c.partition_id], part_begin[c.partition_id+1] - 1);
+            push_cursor(c.partition_id, pos, 1);
+            push_cursor(c.partition_id, pos - 1, -1);
+            continue;
         }
+
+        double d = bench::common::eu_dist(_data[c.pos], point);
+        if (knn.size() < k) {
+            knn.emplace(d, c.pos);
+        } else if (d < knn.top().first) {
+            knn.pop();
+            knn.emplace(d, c.pos);
+        }
+        push_cursor(c.partition_id, c.pos + c.dir, c.dir);
     }
+
+    auto end = std::chrono::steady_clock::now();
+    knn_time += std::chrono::duration_cast<std::chrono::microseconds>(end - start).count();
+    knn_count ++;
+
+    Points result(knn.size());
+    for (size_t i=knn.size(); i-- > 0; ) {
+        result[i] = _data[knn.top().second];
+        knn.pop();
+    }
+    return result;
+}
+
+inline size_t partition_count() {
+    return this->p;
 }
 
 private:
 // raw data
 Points _data;
 
+// partition number
+size_t p;
+
 // vec of means of each partition
 Points means; 
 
 // vec of radius of each partition
-std::array<double, p> radii;
+std::vector<double> radii;
 
 // vec of offsets
-std::array<double, p> offsets;
+std::vector<double> offsets;
+
+// the first position of each partition in _data, part_begin[p] is the number of points
+std::vector<size_t> part_begin;
 
 // underlying pgm learned index
 pgm::PGMIndex<double, eps>* _pgm; 
 
-// find the closest partition center to a query point
-inline size_t find_closest_center(Point& point) {
+// partitions sorted by the distance from their centers to a pivot point, used to prune partitions
+Point pivot;
+std::vector<size_t> pivot_order;
+std::vector<double> pivot_dists;
+double max_radius;
+// the centers in pivot order, all the first coordinates first, for the batched distance kernel
+std::vector<double> centres_soa;
+
+inline void build_centre_list() {
+    // the pivot is the min corner of the bounding box of centers
+    std::fill(pivot.begin(), pivot.end(), std::numeric_limits<double>::max());
+    for (auto& m : means) {
+        for (size_t d=0; d<dim; ++d) {
+            pivot[d] = std::min(pivot[d], m[d]);
+        }
+    }
+
+    pivot_order.resize(p);
+    for (size_t i=0; i<p; ++i) {
+        pivot_order[i] = i;
+    }
+    std::vector<double> dists(p);
+    for (size_t i=0; i<p; ++i) {
+        dists[i] = bench::common::eu_dist(means[i], pivot);
+    }
+    std::sort(pivot_order.begin(), pivot_order.end(), [&](size_t a, size_t b) { return dists[a] < dists[b]; });
+
+    pivot_dists.resize(p);
+    centres_soa.resize(dim * p);
+    for (size_t j=0; j<p; ++j) {
+        pivot_dists[j] = dists[pivot_order[j]];
+        for (size_t d=0; d<dim; ++d) {
+            centres_soa[d * p + j] = means[pivot_order[j]][d];
+        }
+    }
+
+    max_radius = *std::max_element(radii.begin(), radii.end());
+}
+
+// min and max distances from the box to the centers in [lo, hi) of the pivot order
+// the loops over centers are vectorized
+inline void box_dists(Box& box, size_t lo, size_t hi, double* min_out, double* max_out) {
+    std::fill(min_out + lo, min_out + hi, 0.0);
+    std::fill(max_out + lo, max_out + hi, 0.0);
+    for (size_t d=0; d<dim; ++d) {
+        const double* c = centres_soa.data() + d * p;
+        const double box_lo = box.min_corner()[d];
+        const double box_hi = box.max_corner()[d];
+        for (size_t j=lo; j<hi; ++j) {
+            double below = box_lo - c[j];
+            double above = c[j] - box_hi;
+            double gap = std::max(0.0, std::max(below, above));
+            double far = std::max(c[j] - box_lo, box_hi - c[j]);
+            min_out[j] += gap * gap;
+            max_out[j] += far * far;
+        }
+    }
+    for (size_t j=lo; j<hi; ++j) {
+        min_out[j] = std::sqrt(min_out[j]);
+        max_out[j] = std::sqrt(max_out[j]);
+    }
+}
+
+// distances from q_point to the centers in [lo, hi) of the pivot order
+// the loop over centers is vectorized
+inline void centre_dists(Point& q_point, size_t lo, size_t hi, double* out) {
+    std::fill(out + lo, out + hi, 0.0);
+    for (size_t d=0; d<dim; ++d) {
+        const double* c = centres_soa.data() + d * p;
+        const double x = q_point[d];
+        for (size_t j=lo; j<hi; ++j) {
+            double delta = x - c[j];
+            out[j] += delta * delta;
+        }
+    }
+    for (size_t j=lo; j<hi; ++j) {
+        out[j] = std::sqrt(out[j]);
+    }
+}
+
+// the partition of a point, i.e., its closest center, and its distance to the center
+inline std::pair<size_t, double> assign(Point& point) {
     size_t j = 0;
     double min_dist = std::numeric_limits<double>::max();
     for (size_t i=0; i<p; ++i) {
@@ -266,22 +461,145 @@ inline size_t find_closest_center(Point& point) {
         }
     }
 
-    return j;
+    return std::make_pair(j, min_dist);
 }
 
 // the ML-Index projection function
 inline double project(Point& point) {
-    size_t j = 0;
-    double min_dist = std::numeric_limits<double>::max();
-    for (size_t i=0; i<p; ++i) {
-        double temp_dist = bench::common::eu_dist(means[i], point);
-        if (temp_dist < min_dist) {
-            min_dist = temp_dist;
-            j = i;
+    auto [j, dist] = assign(point);
+    return offsets[j] + dist;
+}
+
+// choose the partition number with the lowest estimated cost per query of the workload
+// candidates are powers of two, the search stops once two candidates in a row are worse than the best one
+inline size_t tune_partitions(Points& points, const std::vector<Box>& workload) {
+    // the sample is drawn with a fixed random seed for reproduction
+    Points sample;
+    if (points.size() <= tuning_sample_size) {
+        sample = points;
+    } else {
+        std::mt19937 gen(0);
+        std::uniform_int_distribution<size_t> pick(0, points.size() - 1);
+        sample.reserve(tuning_sample_size);
+        for (size_t i=0; i<tuning_sample_size; ++i) {
+            sample.emplace_back(points[pick(gen)]);
+        }
+    }
+
+    size_t max_partitions = sample.size() / min_tuning_partition_size;
+    if (max_partitions < min_tuning_partitions) {
+        return std::max<size_t>(1, max_partitions);
+    }
+
+    std::vector<Box> queries = workload.empty() ? default_workload(sample) : workload;
+
+    size_t best = min_tuning_partitions;
+    double best_cost = std::numeric_limits<double>::max();
+    double best_scanned = 0.0;
+    size_t worse = 0;
+    for (size_t k=min_tuning_partitions; k<=max_partitions && worse<2; k*=2) {
+        double scanned = 0.0;
+        double cost = estimate_cost(sample, points.size(), queries, k, scanned);
+        if (cost < best_cost) {
+            best = k;
+            best_cost = cost;
+            best_scanned = scanned;
+            worse = 0;
+        } else {
+            ++worse;
+        }
+    }
+
+    std::cout << "Tuned Partitions: " << best << " Expected Scanned Keys: " << static_cast<size_t>(best_scanned) << std::endl;
+    return best;
+}
+
+// the estimated cost per query of the workload with k partitions, and the expected keys scanned per query
+// the sample is clustered by the k-means policy, the keys within each annulus are counted on the sample
+// and scaled to n points
+inline double estimate_cost(Points& sample, size_t n, const std::vector<Box>& queries, size_t k, double& scanned) {
+    auto clusters = KMeans::cluster(sample, k);
+    Points centres(std::get<0>(clusters).begin(), std::get<0>(clusters).end());
+
+    // sorted distances of the sampled points to their closest centers, by partition
+    std::vector<std::pair<size_t, double>> sample_assignments(sample.size());
+    bench::common::parallel_for(sample.size(), [&](size_t lo, size_t hi) {
+        for (size_t i=lo; i<hi; ++i) {
+            size_t j = 0;
+            double min_dist = std::numeric_limits<double>::max();
+            for (size_t c=0; c<centres.size(); ++c) {
+                double temp_dist = bench::common::eu_dist(centres[c], sample[i]);
+                if (temp_dist < min_dist) {
+                    min_dist = temp_dist;
+                    j = c;
+                }
+            }
+            sample_assignments[i] = std::make_pair(j, min_dist);
+        }
+    });
+
+    std::vector<std::vector<double>> dists(centres.size());
+    for (auto [pid, dist] : sample_assignments) {
+        dists[pid].emplace_back(dist);
+    }
+    for (auto& d : dists) {
+        std::sort(d.begin(), d.end());
+    }
+
+    const double scale = static_cast<double>(n) / sample.size();
+    double keys = 0.0;
+    size_t searched = 0;
+    for (auto& box : queries) {
+        for (size_t i=0; i<centres.size(); ++i) {
+            if (dists[i].empty()) {
+                continue;
+            }
+            double min_sq = 0.0, max_sq = 0.0;
+            for (size_t d=0; d<dim; ++d) {
+                double gap = std::max(0.0, std::max(box.min_corner()[d] - centres[i][d], centres[i][d] - box.max_corner()[d]));
+                double far = std::max(centres[i][d] - box.min_corner()[d], box.max_corner()[d] - centres[i][d]);
+                min_sq += gap * gap;
+                max_sq += far * far;
+            }
+            double t_lo = std::sqrt(min_sq), t_hi = std::sqrt(max_sq);
+            if (t_lo > dists[i].back()) {
+                continue;
+            }
+            ++searched;
+            auto first = std::lower_bound(dists[i].begin(), dists[i].end(), t_lo);
+            auto last = std::upper_bound(first, dists[i].end(), t_hi);
+            keys += (last - first) * scale;
         }
     }
 
-    return offsets[j] + min_dist;
+    scanned = keys / queries.size();
+    return scanned + partition_cost * searched / queries.size() + centre_cost * centres.size();
+}
+
+// range queries of about 1% selectivity around random points, assuming uniform and independent dimensions
+inline std::vector<Box> default_workload(Points& sample, size_t s=100) {
+    Point lo, hi;
+    std::fill(lo.begin(), lo.end(), std::numeric_limits<double>::max());
+    std::fill(hi.begin(), hi.end(), std::numeric_limits<double>::lowest());
+    for (auto& point : sample) {
+        for (size_t d=0; d<dim; ++d) {
+            lo[d] = std::min(lo[d], point[d]);
+            hi[d] = std::max(hi[d], point[d]);
+        }
+    }
+
+    std::mt19937 gen(0);
+    std::uniform_int_distribution<size_t> pick(0, sample.size() - 1);
+    std::vector<Box> queries;
+    queries.reserve(s);
+    for (size_t i=0; i<s; ++i) {
+        Point min_corner = sample[pick(gen)], max_corner;
+        for (size_t d=0; d<dim; ++d) {
+            max_corner[d] = std::min(min_corner[d] + (hi[d] - lo[d]) * std::pow(0.01, 1.0/dim), hi[d]);
+        }
+        queries.emplace_back(min_corner, max_corner);
+    }
+    return queries;
 }
 
 };
@@ -9,6 +9,7 @@
 #include "../base_index.hpp"
 #include "../../utils/type.hpp"
 #include "../../utils/common.hpp"
+#include "../../utils/parallel.hpp"
 #include "../pgm/pgm_index.hpp"
 #include "../pgm/pgm_index_variants.hpp"
 #include "../pgm/morton_nd.hpp"
@@ -17,15 +18,24 @@
 namespace bench { namespace index {
 
 // Epsilon: the error bound of the underlying 1-D learned index
+// beyond 6 dimensions a 64-bit z-value leaves too few bits per dimension,
+// so 128-bit z-values are used instead
 template<size_t Dim, size_t Epsilon=64>
 class ZMIndex : public BaseIndex {
 
 using Point = point_t<Dim>;
 using Points = std::vector<Point>;
 using Box = box_t<Dim>;
-using Index = pgm::MultidimensionalPGMIndex<Dim, size_t, Epsilon>;
-using morton = mortonnd::MortonNDBmi<Dim, uint64_t>;
-using value_type = decltype(morton::Decode(0));
+using key_type = std::conditional_t<(Dim > 6), unsigned __int128, uint64_t>;
+using Index = pgm::MultidimensionalPGMIndex<Dim, key_type, Epsilon>;
+using value_type = typename Index::value_type;
+
+// the largest grid resolution the z-value can encode
+// one bit per dimension is reserved by the underlying index
+static constexpr size_t max_resolution = (size_t(1) << (sizeof(key_type) * 8 / Dim - 1)) - 1;
+
+// number of points whose grid ids are computed together before interleaving
+static constexpr size_t batch_size = 64;
 
 public:
 
@@ -46,20 +56,28 @@ ZMIndex(Points& points) : _data(points) {
     }
 
     // the grid resolution to calculate the Z-value is set to N^{1/d}
-    this->resolution = static_cast<size_t>(pow(_data.size(), 1.0/Dim));
+    // with 128-bit z-values it is set to the finest resolution the z-value can encode
+    if constexpr (sizeof(key_type) > sizeof(uint64_t)) {
+        this->resolution = max_resolution;
+    } else {
+        this->resolution = std::min(static_cast<size_t>(pow(_data.size(), 1.0/Dim)), max_resolution);
+    }
+    std::cout << "Resolution: " << this->resolution << " Key Bits: " << sizeof(key_type) * 8 << std::endl;
     
     // widths of each dimension
     for (size_t i=0; i<Dim; ++i) {
         widths[i] = (maxs[i] - mins[i]) / this->resolution;
+        tops[i] = (maxs[i] - mins[i]) / widths[i];
     }
 
-    std::vector<value_type> tuples;
-    tuples.reserve(points.size());
-    for (auto& p: points) {
-        tuples.emplace_back(a2t(p));
-    }
+    // encode z-values directly instead of materializing grid id tuples
+    std::vector<key_type> keys(points.size());
+    bench::common::parallel_for(points.size(), [&](size_t lo, size_t hi) {
+        encode_batch(points.data() + lo, hi - lo, keys.data() + lo);
+    });
+    bench::common::parallel_sort(keys);
     
-    pgm_idx = new Index(tuples.begin(), tuples.end());
+    pgm_idx = new Index(std::move(keys));
 
     auto end = std::chrono::steady_clock::now();
     build_time = std::chrono::duration_cast<std::chrono::milliseconds>(end - start).count();
@@ -151,6 +169,8 @@ size_t resolution;
 std::array<double, Dim> mins;
 std::array<double, Dim> maxs;
 std::array<double, Dim> widths;
+// the (fractional) grid id of maxs on each dimension
+std::array<double, Dim> tops;
 
 // internal data
 Points& _data;
@@ -158,14 +178,45 @@ Points& _data;
 Index* pgm_idx;
 
 // turn a double point to ints to compute the z-value
+// the clamping is branch-free so that the same code vectorizes in quantize()
 inline size_t to_id(double val, size_t I) {
-    if (val <= this->mins[I]) {
-        return 0;
+    double t = (val - this->mins[I]) / this->widths[I];
+    t = (t < 0.0) ? 0.0 : t;
+    t = (t > this->tops[I]) ? this->tops[I] : t;
+    return static_cast<size_t>(t);
+}
+
+// compute the grid ids of n points (n <= batch_size) on dimension d
+inline void quantize(const Point* pts, size_t n, size_t d, uint64_t* ids) {
+    const double lo = this->mins[d];
+    const double width = this->widths[d];
+    const double top = this->tops[d];
+    for (size_t i=0; i<n; ++i) {
+        double t = (pts[i][d] - lo) / width;
+        t = (t < 0.0) ? 0.0 : t;
+        t = (t > top) ? top : t;
+        ids[i] = static_cast<uint64_t>(t);
     }
-    if (val >= this->maxs[I]) {
-        return (this->maxs[I] - this->mins[I]) / this->widths[I];
+}
+
+// compute the z-values of n contiguous points
+// grid ids of a batch are computed dimension by dimension and then interleaved with pdep point by point
+inline void encode_batch(const Point* first, size_t n, key_type* out) {
+    std::array<std::array<uint64_t, batch_size>, Dim> ids;
+    uint64_t fields[Dim];
+
+    for (size_t b=0; b<n; b+=batch_size) {
+        size_t m = std::min(batch_size, n - b);
+        for (size_t d=0; d<Dim; ++d) {
+            quantize(first + b, m, d, ids[d].data());
+        }
+        for (size_t i=0; i<m; ++i) {
+            for (size_t d=0; d<Dim; ++d) {
+                fields[d] = ids[d][i];
+            }
+            out[b + i] = Index::encode_fields(fields);
+        }
     }
-    return static_cast<size_t>((val - this->mins[I])/this->widths[I]);
 }
 
 template<typename Array, std::size_t... I>
@@ -4,6 +4,7 @@
 #include <array>
 #include <cstddef>
 #include <iostream>
+#include <limits>
 #include <map>
 #include <utility>
 #include <vector>
@@ -55,9 +56,12 @@ EDG(Points& points) {
         }
     }
 
+    // insert points to buckets
     for (auto& p : points) {
         buckets[compute_id(p)].emplace_back(p);
     }
+    // record the extent of the points of every column on each dimension
+    bench::common::column_extents<Dim>(points.begin(), points.end(), [this](Point& p, size_t d) { return get_dim_idx(p, d); }, col_mins, col_maxs);
 
     auto end = std::chrono::steady_clock::now();
     build_time = std::chrono::duration_cast<std::chrono::milliseconds>(end - start).count();
@@ -68,44 +72,20 @@ EDG(Points& points) {
 
 Points range_query(Box& box) {
     auto start = std::chrono::steady_clock::now();
-    // bucket ranges that intersect the query box
-    std::vector<Range> ranges;
-
-    // search range on the 1-st dimension
-    ranges.emplace_back(get_dim_idx(box.min_corner(), 0), get_dim_idx(box.max_corner(), 0));
-    
-    // find all intersect ranges
-    for (size_t i=1; i<Dim; ++i) {
-        auto start_idx = get_dim_idx(box.min_corner(), i);
-        auto end_idx = get_dim_idx(box.max_corner(), i);
-
-        std::vector<Range> temp_ranges;
-        for (auto idx=start_idx; idx<=end_idx; ++idx) {
-            for (size_t j=0; j<ranges.size(); ++j) {
-                temp_ranges.emplace_back(ranges[j].first + idx*dim_offset[i], ranges[j].second + idx*dim_offset[i]);
-            }
-        }
-
-        // update the range vector
-        ranges = temp_ranges;
-    }
-
-    // Points candidates;
+    // cells covered by the box are copied as a whole, the others are refined on the dimensions that cut them
     Points result;
-
-    // find candidate points
-    for (auto& range : ranges) {
-        auto start_idx = range.first;
-        auto end_idx = range.second;
-
-        for (auto idx=start_idx; idx<=end_idx; ++idx) {
-            for (auto& cand : this->buckets[idx]) {
-                if (bench::common::is_in_box(cand, box)) {
-                    result.emplace_back(cand);
-                }
+    bench::common::grid_range_scan<Dim>(box, [this](Point& p, size_t d) { return get_dim_idx(p, d); }, col_mins, col_maxs, dim_offset, result,
+        [this](size_t first, size_t last) {
+            size_t size = 0;
+            for (auto idx=first; idx<=last; ++idx) {
+                size += this->buckets[idx].size();
             }
-        }
-    }
+            return size;
+        },
+        [&](size_t idx, uint32_t mask) {
+            auto& bucket = this->buckets[idx];
+            bench::common::emit_cell_points(result, bucket.begin(), bucket.end(), box, mask);
+        });
 
     auto end = std::chrono::steady_clock::now();
     range_count ++;
@@ -119,7 +99,7 @@ inline size_t count() {
 }
 
 inline size_t index_size() {
-    return Dim * K * sizeof(double) + Dim * sizeof(size_t) + buckets.size() * sizeof(Points);
+    return Dim * K * sizeof(double) + Dim * sizeof(size_t) + 2 * Dim * K * sizeof(double) + buckets.size() * sizeof(Points);
 }
 
 void print_partitions() {
@@ -136,6 +116,9 @@ size_t N;
 std::array<Points, bench::common::ipow(K, Dim)> buckets;
 std::array<size_t, Dim> dim_offset;
 Partitions partitions; // bucket boundaries on each dimension
+// extent of the points of each column on each dimension
+Partitions col_mins;
+Partitions col_maxs;
 
 // locate the bucket on d-th dimension using binary search
 inline size_t get_dim_idx(Point& p, size_t d) {
@@ -0,0 +1,293 @@
+#pragma once
+
+#include "../../utils/type.hpp"
+#include "../../utils/common.hpp"
+#include "../../utils/parallel.hpp"
+#include "../base_index.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <chrono>
+#include <iostream>
+#include <limits>
+#include <queue>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+namespace bench { namespace index {
+
+// a static packed R-tree stored in flat arrays
+// the points are tiled top-down by sort-tile-recursive (STR) packing so that every node but the last
+// of a level is full, the children of node i are then the nodes [i * Fanout, (i + 1) * Fanout)
+// of the level below and a node at level l covers the points [i * Fanout^(l+1), (i + 1) * Fanout^(l+1)),
+// no child pointers or point ids are stored
+// the MBRs of the children of a node are stored together in SoA layout (the min of every dimension,
+// then the max of every dimension), so that a node is tested against a query in one vectorized loop,
+// the last block of a level is padded with empty MBRs
+template<size_t Dim, size_t Fanout=16>
+class FlatRTree : public BaseIndex {
+
+using Point = point_t<Dim>;
+using Box = box_t<Dim>;
+using Points = std::vector<point_t<Dim>>;
+
+// the number of doubles of the MBRs of one block of Fanout nodes
+static constexpr size_t BlockSize = 2 * Dim * Fanout;
+
+public:
+FlatRTree(Points& points) : _data(points) {
+    std::cout << "Construct Flat R-tree " << "Fanout=" << Fanout << std::endl;
+
+    auto start = std::chrono::steady_clock::now();
+
+    // the number of points covered by a node of each level, the root is not stored
+    const size_t n = _data.size();
+    _span.emplace_back(Fanout);
+    while ((n + _span.back() - 1) / _span.back() > Fanout) {
+        _span.emplace_back(_span.back() * Fanout);
+    }
+
+    // tile every node into its children, from the children of the root down to the leaves
+    // a node has too few children to cut every dimension in high dimensions,
+    // so the dimensions are cut in the order of the extent of the node, widest first
+    for (size_t l=_span.size(); l-- > 0; ) {
+        const size_t parent_span = _span[l] * Fanout;
+        bench::common::parallel_tasks((n + parent_span - 1) / parent_span, [&](size_t i) {
+            auto first = _data.begin() + i * parent_span;
+            auto last = _data.begin() + std::min(n, (i + 1) * parent_span);
+            auto order = widest_dims(first, last);
+            auto coord = [&order](const Point& p, size_t d) { return p[order[d]]; };
+            bench::common::str_tile<Dim>(first, last, _span[l], coord);
+        });
+    }
+
+    // the MBRs bottom-up, a node of an upper level bounds the block of its children
+    _mbrs.resize(_span.size());
+    for (size_t l=0; l<_span.size(); ++l) {
+        const size_t nodes = (n + _span[l] - 1) / _span[l];
+        const size_t blocks = std::max<size_t>(1, (nodes + Fanout - 1) / Fanout);
+        auto& mbrs = _mbrs[l];
+        mbrs.resize(blocks * BlockSize);
+        for (size_t b=0; b<blocks; ++b) {
+            std::fill_n(mbrs.begin() + b * BlockSize, Dim * Fanout, std::numeric_limits<double>::max());
+            std::fill_n(mbrs.begin() + b * BlockSize + Dim * Fanout, Dim * Fanout, std::numeric_limits<double>::lowest());
+        }
+
+        bench::common::parallel_for(nodes, [&](size_t lo, size_t hi) {
+            for (size_t i=lo; i<hi; ++i) {
+                double* node_lo = &mbrs[(i / Fanout) * BlockSize + i % Fanout];
+                double* node_hi = node_lo + Dim * Fanout;
+                if (l == 0) {
+                    for (size_t j=i*Fanout; j<std::min(n, (i + 1) * Fanout); ++j) {
+                        for (size_t d=0; d<Dim; ++d) {
+                            node_lo[d * Fanout] = std::min(node_lo[d * Fanout], _data[j][d]);
+                            node_hi[d * Fanout] = std::max(node_hi[d * Fanout], _data[j][d]);
+                        }
+                    }
+                } else {
+                    const double* children = &_mbrs[l - 1][i * BlockSize];
+                    for (size_t d=0; d<Dim; ++d) {
+                        for (size_t j=0; j<Fanout; ++j) {
+                            node_lo[d * Fanout] = std::min(node_lo[d * Fanout], children[d * Fanout + j]);
+                            node_hi[d * Fanout] = std::max(node_hi[d * Fanout], children[(Dim + d) * Fanout + j]);
+                        }
+                    }
+                }
+            }
+        }, 1 << 10);
+    }
+
+    auto end = std::chrono::steady_clock::now();
+    build_time = std::chrono::duration_cast<std::chrono::milliseconds>(end - start).count();
+    std::cout << "Build Time: " << get_build_time() << " [ms]" << std::endl;
+    std::cout << "Index Size: " << index_size() << " Bytes" << std::endl;
+}
+
+inline Points range_query(Box& box) {
+    auto start = std::chrono::steady_clock::now();
+    Points return_values;
+
+    std::array<uint8_t, Fanout> hit, inside;
+    // the blocks to visit as (level, parent node), starting with the children of the root
+    std::vector<std::pair<size_t, size_t>> stack;
+    stack.emplace_back(_span.size() - 1, 0);
+    while (!stack.empty()) {
+        auto [level, block] = stack.back();
+        stack.pop_back();
+
+        classify(&_mbrs[level][block * BlockSize], box, hit, inside);
+        for (size_t j=0; j<Fanout; ++j) {
+            if (!hit[j]) {
+                continue;
+            }
+            const size_t node = block * Fanout + j;
+            const size_t first = node * _span[level];
+            const size_t last = std::min(_data.size(), first + _span[level]);
+            if (inside[j]) {
+                // the points of a subtree are contiguous
+                return_values.insert(return_values.end(), _data.begin() + first, _data.begin() + last);
+            } else if (level == 0) {
+                for (size_t i=first; i<last; ++i) {
+                    if (bench::common::is_in_box(_data[i], box)) {
+                        return_values.emplace_back(_data[i]);
+                    }
+                }
+            } else {
+                stack.emplace_back(level - 1, node);
+            }
+        }
+    }
+
+    auto end = std::chrono::steady_clock::now();
+    range_count++;
+    range_time += std::chrono::duration_cast<std::chrono::microseconds>(end - start).count();
+
+    return return_values;
+}
+
+// best-first search over the nodes by their minimum distance to the query point
+inline Points knn_query(Point& q, unsigned int k) {
+    auto start = std::chrono::steady_clock::now();
+
+    // the k closest points found so far, a max-heap on squared distance
+    std::priority_queue<std::pair<double, size_t>> knn;
+    // the nodes to visit as (squared minimum distance, level, node), a min-heap on distance
+    using Entry = std::tuple<double, size_t, size_t>;
+    std::priority_queue<Entry, std::vector<Entry>, std::greater<Entry>> frontier;
+
+    std::array<double, Fanout> dists;
+    auto expand = [&](size_t level, size_t block) {
+        min_dists(&_mbrs[level][block * BlockSize], q, dists);
+        for (size_t j=0; j<Fanout; ++j) {
+            // padding nodes are at infinity
+            if (dists[j] < std::numeric_limits<double>::max() && (knn.size() < k || dists[j] < knn.top().first)) {
+                frontier.emplace(dists[j], level, block * Fanout + j);
+            }
+        }
+    };
+
+    if (k > 0 && !_data.empty()) {
+        expand(_span.size() - 1, 0);
+    }
+    while (!frontier.empty()) {
+        auto [dist, level, node] = frontier.top();
+        frontier.pop();
+        if (knn.size() == k && dist >= knn.top().first) {
+            break;
+        }
+
+        if (level > 0) {
+            expand(level - 1, node);
+            continue;
+        }
+        const size_t last = std::min(_data.size(), (node + 1) * Fanout);
+        for (size_t i=node*Fanout; i<last; ++i) {
+            double d = bench::common::eu_dist_square(_data[i], q);
+            if (knn.size() < k) {
+                knn.emplace(d, i);
+            } else if (d < knn.top().first) {
+                knn.pop();
+                knn.emplace(d, i);
+            }
+        }
+    }
+
+    auto end = std::chrono::steady_clock::now();
+    knn_count++;
+    knn_time += std::chrono::duration_cast<std::chrono::microseconds>(end - start).count();
+
+    Points return_values(knn.size());
+    for (size_t i=knn.size(); i-- > 0; ) {
+        return_values[i] = _data[knn.top().second];
+        knn.pop();
+    }
+
+    return return_values;
+}
+
+inline size_t count() {
+    return _data.size();
+}
+
+// the node MBRs and the points in leaf order, which are the leaves, as the boost R-tree size counts its leaf entries
+inline size_t index_size() {
+    size_t size = _span.size() * sizeof(size_t) + _data.size() * sizeof(Point);
+    for (auto& mbrs : _mbrs) {
+        size += mbrs.size() * sizeof(double);
+    }
+    return size;
+}
+
+private:
+// the points in leaf order
+Points _data;
+// _span[l] is the number of points covered by a node at level l, level 0 are the leaves
+std::vector<size_t> _span;
+// the node MBRs of every level in blocks of Fanout siblings
+std::vector<std::vector<double>> _mbrs;
+
+// the dimensions ordered by the extent of the points of [first, last), widest first
+template<typename It>
+inline std::array<size_t, Dim> widest_dims(It first, It last) {
+    Point mins, maxs;
+    std::fill(mins.begin(), mins.end(), std::numeric_limits<double>::max());
+    std::fill(maxs.begin(), maxs.end(), std::numeric_limits<double>::lowest());
+    for (auto it=first; it!=last; ++it) {
+        for (size_t d=0; d<Dim; ++d) {
+            mins[d] = std::min(mins[d], (*it)[d]);
+            maxs[d] = std::max(maxs[d], (*it)[d]);
+        }
+    }
+
+    std::array<size_t, Dim> order;
+    for (size_t d=0; d<Dim; ++d) {
+        order[d] = d;
+    }
+    std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) { return maxs[a] - mins[a] > maxs[b] - mins[b]; });
+    return order;
+}
+
+// whether each node of a block intersects the box and whether it lies inside it
+inline void classify(const double* block, Box& box, std::array<uint8_t, Fanout>& hit, std::array<uint8_t, Fanout>& inside) {
+    hit.fill(1);
+    inside.fill(1);
+    for (size_t d=0; d<Dim; ++d) {
+        const double* lo = block + d * Fanout;
+        const double* hi = block + (Dim + d) * Fanout;
+        const double q_lo = box.min_corner()[d];
+        const double q_hi = box.max_corner()[d];
+        for (size_t j=0; j<Fanout; ++j) {
+            hit[j] &= (lo[j] <= q_hi) & (hi[j] >= q_lo);
+            inside[j] &= (lo[j] >= q_lo) & (hi[j] <= q_hi);
+        }
+    }
+}
+
+// the squared minimum distance from the point to each node of a block, padding nodes are at infinity
+inline void min_dists(const double* block, Point& q, std::array<double, Fanout>& dists) {
+    dists.fill(0.0);
+    for (size_t d=0; d<Dim; ++d) {
+        const double* lo = block + d * Fanout;
+        const double* hi = block + (Dim + d) * Fanout;
+        for (size_t j=0; j<Fanout; ++j) {
+            double below = lo[j] - q[d];
+            double above = q[d] - hi[j];
+            double gap = below > above ? below : above;
+            gap = gap > 0.0 ? gap : 0.0;
+            dists[j] += gap * gap;
+        }
+    }
+    for (size_t j=0; j<Fanout; ++j) {
+        if (block[j] == std::numeric_limits<double>::max()) {
+            dists[j] = std::numeric_limits<double>::max();
+        }
+    }
+}
+
+};
+
+}
+}
@@ -51,7 +51,7 @@ struct FullScan : public BaseIndex {
         for (auto p : _data) {
             if (queue.size() < k) {
                 queue.push(std::make_pair(p, bench::common::eu_dist_square(p, q)));
-            } else {
+            } else if (k > 0) {
                 QueueElement const& top_element = queue.top();
                 double new_dist = bench::common::eu_dist_square(p, q);
                 if (new_dist < top_element.second) {
@@ -1,6 +1,7 @@
 #pragma once
 
 #include "rtree.hpp"
+#include "flat_rtree.hpp"
 #include "kdtree.hpp"
 #include "ann.hpp"
 #include "uniform_grid.hpp"
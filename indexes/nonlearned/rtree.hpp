@@ -67,6 +67,24 @@ inline Points knn_query(Point& q, unsigned int k) {
     return return_values;
 }
 
+inline void insert(Point& p) {
+    auto start = std::chrono::steady_clock::now();
+    rtree->insert(p);
+    auto end = std::chrono::steady_clock::now();
+    insert_count++;
+    insert_time += std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count();
+}
+
+inline bool remove(Point& p) {
+    auto start = std::chrono::steady_clock::now();
+    bool found = (rtree->remove(p) > 0);
+    auto end = std::chrono::steady_clock::now();
+    remove_count++;
+    remove_time += std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count();
+
+    return found;
+}
+
 inline size_t count() {
     return rtree->size();
 }
@@ -88,20 +106,30 @@ using Points = std::vector<point_t<dim>>;
 using rtree_t = bgi::rtree<Point, bgi::rstar<MaxElements>>;
 
 public:
-RStarTree(Points& points) {
-    std::cout << "Construct R*-tree " << "MaxElements=" << MaxElements << std::endl;
+// by default the points are inserted one by one through the R* split and forced reinsertion heuristics,
+// packed builds the same tree by the packing algorithm instead, as a baseline for the query latency
+RStarTree(Points& points, bool packed=false) {
+    std::cout << "Construct R*-tree " << "MaxElements=" << MaxElements << " Packed=" << packed << std::endl;
 
     auto start = std::chrono::steady_clock::now();
 
-    rtree = new rtree_t();
-
-    for (auto& p : points) {
-        rtree->insert(p);
+    if (packed) {
+        rtree = new rtree_t(points.begin(), points.end());
+    } else {
+        rtree = new rtree_t();
+        for (auto& p : points) {
+            rtree->insert(p);
+        }
     }
 
     auto end = std::chrono::steady_clock::now();
     build_time = std::chrono::duration_cast<std::chrono::milliseconds>(end - start).count();
     std::cout << "Build Time: " << get_build_time() << " [ms]" << std::endl;
+    if (!packed && !points.empty()) {
+        double ns = std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count();
+        std::cout << "Build Inserts: " << points.size() << " Avg. Time: " << ns / points.size() << " [ns]"
+                  << " Throughput: " << points.size() / (ns / 1e9) << " [inserts/s]" << std::endl;
+    }
     std::cout << "Index Size: " << index_size() << " Bytes" << std::endl;
 }
 
@@ -131,6 +159,24 @@ inline Points knn_query(Point& q, unsigned int k) {
     return return_values;
 }
 
+inline void insert(Point& p) {
+    auto start = std::chrono::steady_clock::now();
+    rtree->insert(p);
+    auto end = std::chrono::steady_clock::now();
+    insert_count++;
+    insert_time += std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count();
+}
+
+inline bool remove(Point& p) {
+    auto start = std::chrono::steady_clock::now();
+    bool found = (rtree->remove(p) > 0);
+    auto end = std::chrono::steady_clock::now();
+    remove_count++;
+    remove_time += std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count();
+
+    return found;
+}
+
 inline size_t count() {
     return rtree->size();
 }
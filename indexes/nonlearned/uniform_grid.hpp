@@ -62,9 +62,11 @@ public:
         }
         
         // insert points to buckets
-        for (auto p : points) {
+        for (auto& p : points) {
             buckets[compute_id(p)].emplace_back(p);
         }
+        // record the extent of the points of every column on each dimension
+        bench::common::column_extents<dim>(points.begin(), points.end(), [this](Point& p, size_t d) { return get_dim_idx(p, d); }, col_mins, col_maxs);
 
         auto end = std::chrono::steady_clock::now();
         build_time = std::chrono::duration_cast<std::chrono::milliseconds>(end - start).count();
@@ -76,44 +78,20 @@ public:
     Points range_query(Box& box) {
         auto start = std::chrono::steady_clock::now();
 
-        // bucket ranges that intersect the query box
-        std::vector<Range> ranges;
-
-        // search range on the 1-st dimension
-        ranges.emplace_back(std::make_pair(get_dim_idx(box.min_corner(), 0), get_dim_idx(box.max_corner(), 0)));
-        
-        // find all intersect ranges
-        for (size_t i=1; i<dim; ++i) {
-            auto start_idx = get_dim_idx(box.min_corner(), i);
-            auto end_idx = get_dim_idx(box.max_corner(), i);
-
-            std::vector<Range> temp_ranges;
-            for (auto idx=start_idx; idx<=end_idx; ++idx) {
-                for (size_t j=0; j<ranges.size(); ++j) {
-                    temp_ranges.emplace_back(std::make_pair(ranges[j].first + idx*dim_offset[i], ranges[j].second + idx*dim_offset[i]));
-                }
-            }
-
-            // update the range vector
-            ranges = temp_ranges;
-        }
-
-        // Points candidates;
+        // cells covered by the box are copied as a whole, the others are refined on the dimensions that cut them
         Points result;
-
-        // find candidate points
-        for (auto range : ranges) {
-            auto start_idx = range.first;
-            auto end_idx = range.second;
-
-            for (auto idx=start_idx; idx<=end_idx; ++idx) {
-                for (auto cand : this->buckets[idx]) {
-                    if (bench::common::is_in_box(cand, box)) {
-                        result.emplace_back(cand);
-                    }
+        bench::common::grid_range_scan<dim>(box, [this](Point& p, size_t d) { return get_dim_idx(p, d); }, col_mins, col_maxs, dim_offset, result,
+            [this](size_t first, size_t last) {
+                size_t size = 0;
+                for (auto idx=first; idx<=last; ++idx) {
+                    size += this->buckets[idx].size();
                 }
-            }
-        }
+                return size;
+            },
+            [&](size_t idx, uint32_t mask) {
+                auto& bucket = this->buckets[idx];
+                bench::common::emit_cell_points(result, bucket.begin(), bucket.end(), box, mask);
+            });
 
         auto end = std::chrono::steady_clock::now();
         range_time += std::chrono::duration_cast<std::chrono::microseconds>(end - start).count();
@@ -127,7 +105,7 @@ public:
     }
 
     inline size_t index_size() {
-        return dim * (3 * sizeof(double) + sizeof(size_t)) + this->buckets.size() * sizeof(Points);
+        return dim * (3 * sizeof(double) + sizeof(size_t)) + 2 * dim * K * sizeof(double) + this->buckets.size() * sizeof(Points);
     }
 
 
@@ -138,6 +116,9 @@ private:
     std::array<double, dim> maxs;
     std::array<double, dim> widths;
     std::array<size_t, dim> dim_offset;
+    // extent of the points of each column on each dimension
+    std::array<std::array<double, K>, dim> col_mins;
+    std::array<std::array<double, K>, dim> col_maxs;
 
     // compute the index on d-th dimension of a given point
     inline size_t get_dim_idx(Point& p, const size_t& d) {
@@ -211,6 +211,110 @@ using MortonNDBmi_3D_32 = MortonNDBmi<3, uint32_t>;
  */
 using MortonNDBmi_3D_64 = MortonNDBmi<3, uint64_t>;
 
+/**
+ * Returns the 128-bit counterpart of 'BuildSelector'.
+ *
+ * @param bits the number of 1-bits to include in the mask.
+ * @param fields the stride of the 1 bits in the mask.
+ * @return the selector mask as an unsigned 128-bit integer.
+ */
+constexpr unsigned __int128 BuildSelector128(std::size_t bits, std::size_t fields) {
+    unsigned __int128 selector = 0;
+    for (std::size_t i = 0; i < bits; ++i) {
+        selector |= (unsigned __int128) 1 << (i * fields);
+    }
+    return selector;
+}
+
+/**
+ * A 128-bit N-dimensional Morton encoder/decoder built on the same BMI2 'pdep' and 'pext'
+ * instructions as 'MortonNDBmi'.
+ *
+ * The 128-bit selector of each field is split at the 64-bit word boundary. The low bits of a field
+ * are deposited into the low word and the remaining bits into the high word, so every field costs
+ * two 'pdep' (or 'pext') operations.
+ *
+ * Fields and decoded components are 64-bit values, the encoding is an 'unsigned __int128'.
+ *
+ * @tparam Dimensions the number of fields (components) to encode, must be > 1.
+ */
+template<std::size_t Dimensions>
+class MortonNDBmi128
+{
+public:
+    using T = unsigned __int128;
+
+    static constexpr auto FieldBits = std::size_t(128) / Dimensions;
+
+    static_assert(Dimensions > 1, "'Dimensions' must be > 1.");
+
+    /**
+     * Calculates the Morton encoding of the specified input fields, see 'MortonNDBmi::Encode'.
+     *
+     * WARNING: Inputs must NOT use more than 'FieldBits' least-significant bits.
+     */
+    template<typename...Args>
+    static inline T Encode(uint64_t field1, Args... fields)
+    {
+        static_assert(sizeof...(Args) == Dimensions - 1, "'Encode' must be called with exactly 'Dimensions' arguments.");
+        return EncodeInternal(field1, fields...);
+    }
+
+    /**
+     * Decodes a Morton code into a tuple of its 64-bit components.
+     */
+    static inline auto Decode(T encoding)
+    {
+        return DecodeInternal(encoding, std::make_index_sequence<Dimensions>{});
+    }
+
+private:
+    MortonNDBmi128() = default;
+
+    static constexpr T Selector = BuildSelector128(FieldBits, Dimensions);
+
+    template<size_t FieldIndex>
+    static constexpr uint64_t LoMask = uint64_t(Selector << FieldIndex);
+
+    template<size_t FieldIndex>
+    static constexpr uint64_t HiMask = uint64_t((Selector << FieldIndex) >> 64);
+
+    // number of bits of a field stored in the low word, always < 64 since Dimensions > 1
+    template<size_t FieldIndex>
+    static constexpr int LoBits = __builtin_popcountll(LoMask<FieldIndex>);
+
+    template<typename...Args>
+    static inline T EncodeInternal(uint64_t field1, Args... fields)
+    {
+        return EncodeInternal(fields...) | Deposit<Dimensions - sizeof...(fields) - 1>(field1);
+    }
+
+    static inline T EncodeInternal(uint64_t field)
+    {
+        return Deposit<Dimensions - 1>(field);
+    }
+
+    template<size_t... i>
+    static inline auto DecodeInternal(T encoding, std::index_sequence<i...>)
+    {
+        return std::make_tuple(Extract<i>(encoding)...);
+    }
+
+    template<size_t FieldIndex>
+    static inline T Deposit(uint64_t field) {
+        auto lo = _pdep_u64(field, LoMask<FieldIndex>);
+        auto hi = _pdep_u64(field >> LoBits<FieldIndex>, HiMask<FieldIndex>);
+        return ((T) hi << 64) | lo;
+    }
+
+    template<size_t FieldIndex>
+    static inline uint64_t Extract(T encoding) {
+        auto lo = _pext_u64(uint64_t(encoding), LoMask<FieldIndex>);
+        auto hi = _pext_u64(uint64_t(encoding >> 64), HiMask<FieldIndex>);
+        return (hi << LoBits<FieldIndex>) | lo;
+    }
+};
+
 }
 
 #endif
@@ -30,6 +30,57 @@ namespace pgm {
 #define PGM_SUB_EPS(x, epsilon) ((x) <= (epsilon) ? 0 : ((x) - (epsilon)))
 #define PGM_ADD_EPS(x, epsilon, size) ((x) + (epsilon) + 2 >= (size) ? (size) : (x) + (epsilon) + 2)
 
+/**
+ * Returns an iterator to the first element in the sorted range [first, last) for which @p comp(element, value) is
+ * false, like std::lower_bound.
+ *
+ * The ranges searched after a @ref PGMIndex query are at most 2*Epsilon+2 elements long. Up to 64 elements are counted
+ * with a branch-free loop that the compiler vectorizes, longer ranges use a binary search whose halving step compiles
+ * to a conditional move, so the last-mile search does not pay for branch mispredictions.
+ * @param first, last the sorted range to search
+ * @param value the value to compare the elements to
+ * @param comp the comparison function, returns true if the element is ordered before @p value
+ * @return an iterator to the first element not ordered before @p value, or @p last if no such element is found
+ */
+template<typename RandomIt, typename T, typename Compare>
+RandomIt branchless_lower_bound(RandomIt first, RandomIt last, const T &value, Compare comp) {
+    size_t n = std::distance(first, last);
+    if (n <= 64) {
+        size_t count = 0;
+        for (size_t i = 0; i < n; ++i)
+            count += comp(first[i], value);
+        return first + count;
+    }
+
+    auto base = first;
+    while (n > 1) {
+        auto half = n / 2;
+        base = comp(base[half], value) ? base + half : base;
+        n -= half;
+    }
+    return base + comp(*base, value);
+}
+
+template<typename RandomIt, typename T>
+RandomIt branchless_lower_bound(RandomIt first, RandomIt last, const T &value) {
+    return branchless_lower_bound(first, last, value, [](const auto &x, const T &v) { return x < v; });
+}
+
+/**
+ * Returns an iterator to the first element in the sorted range [first, last) for which @p comp(value, element) is
+ * true, like std::upper_bound. See @ref branchless_lower_bound.
+ */
+template<typename RandomIt, typename T, typename Compare>
+RandomIt branchless_upper_bound(RandomIt first, RandomIt last, const T &value, Compare comp) {
+    using E = typename std::iterator_traits<RandomIt>::value_type;
+    return branchless_lower_bound(first, last, value, [&comp](const E &x, const T &v) { return !comp(v, x); });
+}
+
+template<typename RandomIt, typename T>
+RandomIt branchless_upper_bound(RandomIt first, RandomIt last, const T &value) {
+    return branchless_upper_bound(first, last, value, [](const T &v, const auto &x) { return v < x; });
+}
+
 /**
  * A struct that stores the result of a query to a @ref PGMIndex, that is, a range [@ref lo, @ref hi)
  * centered around an approximate position @ref pos of the sought key.
@@ -77,6 +128,10 @@ protected:
     K first_key;                        ///< The smallest element.
     std::vector<Segment> segments;      ///< The segments composing the index.
     std::vector<size_t> levels_offsets; ///< The starting position of each level in segments[], in reverse order.
+    std::vector<K> root_keys;           ///< The first keys of the last-level segments, if they are few enough.
+
+    /// The largest number of last-level segments whose keys are kept in the flat root table.
+    static constexpr size_t root_table_max_segments = 1024;
 
     template<typename RandomIt>
     static void build(RandomIt first, RandomIt last,
@@ -132,6 +187,12 @@ protected:
      * @return an iterator to the segment responsible for the given key
      */
     auto segment_for_key(const K &key) const {
+        if (!root_keys.empty()) {
+            // small indexes skip the upper levels with a search on the flat root table
+            auto pos = branchless_upper_bound(root_keys.begin(), root_keys.end(), key) - root_keys.begin();
+            return segments.begin() + (pos > 0 ? pos - 1 : 0);
+        }
+
         if constexpr (EpsilonRecursive == 0) {
             return std::prev(std::upper_bound(segments.begin(), segments.begin() + segments_count(), key));
         }
@@ -180,8 +241,10 @@ public:
         : n(std::distance(first, last)),
           first_key(n ? *first : K(0)),
           segments(),
-          levels_offsets() {
+          levels_offsets(),
+          root_keys() {
         build(first, last, Epsilon, EpsilonRecursive, segments, levels_offsets);
+        build_root_table();
     }
 
     /**
@@ -214,7 +277,24 @@ public:
      * Returns the size of the index in bytes.
      * @return the size of the index in bytes
      */
-    size_t size_in_bytes() const { return segments.size() * sizeof(Segment) + levels_offsets.size() * sizeof(size_t); }
+    size_t size_in_bytes() const {
+        return segments.size() * sizeof(Segment) + levels_offsets.size() * sizeof(size_t) + root_keys.size() * sizeof(K);
+    }
+
+protected:
+
+    /**
+     * Copies the first keys of the last-level segments into a contiguous table, if there are at most
+     * @ref root_table_max_segments of them, so that @ref segment_for_key searches a cache-resident array.
+     */
+    void build_root_table() {
+        auto count = segments_count();
+        if (count == 0 || count > root_table_max_segments)
+            return;
+        root_keys.reserve(count);
+        for (size_t i = 0; i < count; ++i)
+            root_keys.push_back(segments[i].key);
+    }
 };
 
 #pragma pack(push, 1)
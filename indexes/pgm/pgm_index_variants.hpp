@@ -871,6 +871,10 @@ private:
 /**
  * A multidimensional container that uses a @ref PGMIndex for fast orthogonal range queries.
  *
+ * Elements are stored as Morton codes of type @p T, which can be @c uint32_t, @c uint64_t or @c unsigned __int128.
+ * Since the piecewise linear models cannot fit 128-bit keys without overflowing, 128-bit codes are indexed on their
+ * high 64-bit word, and the search is completed on the full codes within the run of equal high words.
+ *
  * @tparam Dimensions the number of fields/dimensions
  * @tparam T the type of the stored elements
  * @tparam Epsilon the Epsilon parameter for the internal @ref PGMIndex
@@ -879,11 +883,14 @@ private:
  */
 template<uint8_t Dimensions, typename T, size_t Epsilon, size_t EpsilonRecursive = 4, typename Floating = float>
 class MultidimensionalPGMIndex {
+    static constexpr bool is_wide = sizeof(T) > sizeof(uint64_t);
+    using pgm_key_type = std::conditional_t<is_wide, uint64_t, T>;
+
     std::vector<T> data;
-    PGMIndex<T, Epsilon, EpsilonRecursive, Floating> pgm;
+    PGMIndex<pgm_key_type, Epsilon, EpsilonRecursive, Floating> pgm;
 
-    using morton = mortonnd::MortonNDBmi<Dimensions, T>;
-    static constexpr auto selector = mortonnd::BuildSelector<morton::FieldBits>(Dimensions);
+    using morton = std::conditional_t<is_wide, mortonnd::MortonNDBmi128<Dimensions>, mortonnd::MortonNDBmi<Dimensions, T>>;
+    static constexpr T selector = T(mortonnd::BuildSelector128(morton::FieldBits, Dimensions));
     static constexpr auto miss_threshold = 64;
 
     class RangeIterator;
@@ -917,7 +924,26 @@ public:
             data.emplace_back(encode(x));
         });
         std::sort(data.begin(), data.end());
-        pgm = decltype(pgm)(data.begin(), data.end());
+        build_pgm();
+    }
+
+    /**
+     * Constructs the multidimensional container on Morton codes computed by the caller with @ref encode_fields.
+     * @param codes the codes of the elements, sorted by the constructor if they are not sorted already
+     */
+    explicit MultidimensionalPGMIndex(std::vector<T> &&codes) : data(std::move(codes)), pgm() {
+        if (!std::is_sorted(data.begin(), data.end()))
+            std::sort(data.begin(), data.end());
+        build_pgm();
+    }
+
+    /**
+     * Returns the Morton code of the element with the given @p fields, each using less than FieldBits bits.
+     * @param fields a pointer to the @p Dimensions fields of the element
+     * @return the Morton code of the element
+     */
+    static T encode_fields(const uint64_t *fields) {
+        return encode_fields(fields, std::make_index_sequence<Dimensions>());
     }
 
     /**
@@ -933,8 +959,7 @@ public:
      */
     bool contains(const value_type &p) {
         auto zp = encode(p);
-        auto range = pgm.search(zp);
-        auto it = std::lower_bound(data.begin() + range.lo, data.begin() + range.hi, zp);
+        auto it = lower_bound(zp);
         return it != data.end() || morton::Decode(*it) == p;
     }
 
@@ -1014,8 +1039,7 @@ public:
 
         // get 2k points around zp to make temporary answer
         auto zp = encode(p);
-        auto range = pgm.search(zp);
-        auto it = std::lower_bound(data.begin() + range.lo, data.begin() + range.hi, zp);
+        auto it = lower_bound(zp);
 
         std::vector<value_type> tmp_ans;
         for (auto i = it - k >= data.begin() ? it - k : data.begin(); i != it + k && i != data.end(); ++i)
@@ -1083,9 +1107,9 @@ private:
                 }
                 else if (++miss > miss_threshold) {
                     miss = 0;
+                    // step back before the first code >= bigmin, so that ++it does not skip codes equal to it
                     auto bmin = bigmin(*it, zmin, zmax);
-                    auto range = super->pgm.search(bmin);
-                    it = std::upper_bound(super->data.begin() + range.lo, super->data.begin() + range.hi, bmin);
+                    it = super->lower_bound(bmin);
                     --it;
                 }
                 ++it;
@@ -1111,8 +1135,7 @@ private:
             if (zmin > zmax)
                 throw std::invalid_argument("min > max");
 
-            auto range = super->pgm.search(zmin);
-            this->it = std::lower_bound(super->data.begin() + range.lo, super->data.begin() + range.hi, zmin);
+            this->it = super->lower_bound(zmin);
             if (this->it == super->data.end())
                 return;
 
@@ -1140,6 +1163,56 @@ private:
         bool operator!=(const iterator &rhs) const { return it != rhs.it; }
     };
 
+    /**
+     * Builds the internal @ref PGMIndex on the sorted codes, or on their high words if the codes are 128-bit wide.
+     */
+    void build_pgm() {
+        if constexpr (is_wide) {
+            std::vector<uint64_t> hi_words;
+            hi_words.reserve(data.size());
+            for (auto &x : data)
+                hi_words.push_back(hi_word(x));
+            pgm = decltype(pgm)(hi_words.begin(), hi_words.end());
+        } else {
+            pgm = decltype(pgm)(data.begin(), data.end());
+        }
+    }
+
+    static uint64_t hi_word(const T &x) {
+        if constexpr (is_wide)
+            return uint64_t(x >> 64);
+        else
+            return x;
+    }
+
+    /**
+     * Returns the range of @ref data where the first code not less than @p z can be found.
+     */
+    auto search_range(const T &z) const {
+        auto range = pgm.search(hi_word(z));
+        auto first = data.begin() + range.lo;
+        auto last = data.begin() + range.hi;
+        if constexpr (is_wide) {
+            // find the run of codes sharing the high word of z, galloping over it since it can exceed the epsilon range
+            auto h = hi_word(z);
+            first = branchless_lower_bound(first, last, h, [](const T &x, uint64_t k) { return hi_word(x) < k; });
+            size_t remaining = std::distance(first, data.end());
+            size_t step = 1;
+            while (step < remaining && hi_word(first[step]) == h)
+                step <<= 1;
+            last = first + std::min(step, remaining);
+        }
+        return std::make_pair(first, last);
+    }
+
+    /**
+     * Returns an iterator to the first code in @ref data not less than @p z.
+     */
+    auto lower_bound(const T &z) const {
+        auto [first, last] = search_range(z);
+        return branchless_lower_bound(first, last, z);
+    }
+
     template<typename Head, typename... Tail>
     constexpr static T encode(const std::tuple<Head, Tail...> &t) {
         return apply([](const auto &head, const auto &... tail) { return morton::Encode(head, tail...); }, t);
@@ -1148,6 +1221,9 @@ private:
     template<typename T1, typename T2>
     constexpr static T encode(const std::pair<T1, T2> &t) { return encode(std::tuple<T1, T2>(t.first, t.second)); }
 
+    template<size_t ...I>
+    static T encode_fields(const uint64_t *fields, std::index_sequence<I...>) { return morton::Encode(fields[I]...); }
+
     template<size_t ...I>
     constexpr static bool box_zcontains_field(const T &min, const T &max, const T &p, std::index_sequence<I...>) {
         return (((min & (selector << I)) <= (p & (selector << I))
@@ -1166,12 +1242,40 @@ private:
      * Loads @p pattern into the bits of @p target associated to the given @p dimension, starting at @p bit_position,
      * leaving the other bits untouched.
      */
-    static T load(T target, T pattern, uint8_t bit_position, uint8_t dimension) {
-        auto mask = ~_pdep_u64(sdsl::bits::lo_set[bit_position], selector << dimension);
-        auto pdep = _pdep_u64(pattern, selector << dimension);
+    static T load(T target, uint64_t pattern, uint8_t bit_position, uint8_t dimension) {
+        auto mask = ~deposit(sdsl::bits::lo_set[bit_position], selector << dimension);
+        auto pdep = deposit(pattern, selector << dimension);
         return (target & mask) | pdep;
     }
 
+    /**
+     * Deposits the low bits of @p pattern into the positions of the set bits of @p mask.
+     */
+    static T deposit(uint64_t pattern, T mask) {
+        if constexpr (is_wide) {
+            auto lo_mask = uint64_t(mask);
+            auto lo = _pdep_u64(pattern, lo_mask);
+            auto lo_bits = __builtin_popcountll(lo_mask);
+            auto hi = lo_bits < 64 ? _pdep_u64(pattern >> lo_bits, uint64_t(mask >> 64)) : 0;
+            return (T(hi) << 64) | lo;
+        } else {
+            return _pdep_u64(pattern, mask);
+        }
+    }
+
+    /**
+     * Returns the position of the most significant set bit of @p x, see @c sdsl::bits::hi.
+     */
+    static int hi_bit(const T &x) {
+        if constexpr (is_wide) {
+            if (hi_word(x) != 0)
+                return 64 + int(sdsl::bits::hi(hi_word(x)));
+            return int(sdsl::bits::hi(uint64_t(x)));
+        } else {
+            return int(sdsl::bits::hi(x));
+        }
+    }
+
     /**
      * Computes the lowest morton code within the range [@p min, @p max] greater than @p x.
      */
@@ -1180,15 +1284,15 @@ private:
         T bigmin = 0;
         T zmin = min;
         T zmax = max;
-        auto hi_bit = std::max(std::max(sdsl::bits::hi(xd), sdsl::bits::hi(zmin)), sdsl::bits::hi(zmax));
+        auto top_bit = std::max(std::max(hi_bit(xd), hi_bit(zmin)), hi_bit(zmax));
 
-        for (int b = hi_bit; b >= 0; --b) {
+        for (int b = top_bit; b >= 0; --b) {
             auto bits = b / Dimensions + 1;
             auto dim = b % Dimensions;
             auto decision = uint8_t((((xd >> b) & 1) << 2) | (((zmin >> b) & 1) << 1) | ((zmax >> b) & 1));
             switch (decision) {
                 case 0b001:
-                    bigmin = load(zmin, T(1) << (bits - 1), bits, dim);
+                    bigmin = load(zmin, uint64_t(1) << (bits - 1), bits, dim);
                     zmax = load(zmax, sdsl::bits::lo_set[bits - 1], bits, dim);
                     break;
 
@@ -1200,7 +1304,7 @@ private:
                     return bigmin;
 
                 case 0b101:
-                    zmin = load(zmin, T(1) << (bits - 1), bits, dim);
+                    zmin = load(zmin, uint64_t(1) << (bits - 1), bits, dim);
                     break;
 
                 default:
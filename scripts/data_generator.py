@@ -30,6 +30,12 @@ def lognormal(n, d, s):
     np.savetxt("{prefix}/synthetic/lognormal{n}_{d}_{s}.csv".format(prefix=DATA_PATH, n=n, d=d, s=s), data, delimiter=',')
 
 
+# generate n d-dimensional points on the integer grid [0, r)^d, with many duplicate points and tied coordinates
+def grid(n, d, r):
+    data = np.random.randint(0, r, [n, d])
+    np.savetxt("{prefix}/synthetic/grid_{n}_{d}_{r}.csv".format(prefix=DATA_PATH, n=n, d=d, r=r), data, delimiter=',', fmt='%d')
+
+
 # generate TPC-H data with a specified scale factor 
 # 4 columns of lineitem table is used (l_quantity, l_extendedprice, l_discount, l_tax)
 # scale factor effect: #rows = 6 * s Million
@@ -108,8 +114,10 @@ if __name__ == "__main__":
             gaussian(args.n, args.d, args.s)
         elif args.dist == "lognormal":
             lognormal(args.n, args.d, args.s)
+        elif args.dist == "grid":
+            grid(args.n, args.d, args.s)
         else:
-            print("Please indicate one of ['uniform', 'gaussian', 'lognormal'].")
+            print("Please indicate one of ['uniform', 'gaussian', 'lognormal', 'grid'].")
     else:
         print("Please indicate correct augments.")
 
@@ -16,7 +16,7 @@ mkdir ${RESULT_PATH}
 #run experiments on default synthetic datasets
 for data in "uniform_20m_2_1" "gaussian_20m_2_1" "lognormal_20m_2_1"
 do
-    for index in "rtree" "rstar" "zm" "mli" "lisa" "fs"
+    for index in "rtree" "rstar" "rstarpacked" "zm" "mli" "lisa" "fs"
     do
         echo "Benchmark ${index} dataset ${data}"
         ${BENCH2D_DEFAULT} ${index} "${DEFAULT_SYN_DATA_PATH}$data" 20000000 all > "${RESULT_PATH}${index}_${data}"
@@ -28,7 +28,7 @@ do
         ${BENCH2D_DEFAULT} ${index} "${DEFAULT_SYN_DATA_PATH}$data" 20000000 knn > "${RESULT_PATH}${index}_${data}"
     done
 
-    for index in "qdtree" "ug" "edg"  "ifi" "flood"
+    for index in "qdtree" "ug" "edg"  "ifi" "flood" "floodfixed"
     do
         echo "Benchmark ${index} dataset ${data}"
         ${BENCH2D_DEFAULT} ${index} "${DEFAULT_SYN_DATA_PATH}$data" 20000000 range > "${RESULT_PATH}${index}_${data}"
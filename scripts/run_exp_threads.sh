@@ -0,0 +1,31 @@
+#!/bin/bash
+
+DATA_PATH="../data/"
+BENCH_BIN_PATH="../build/bin/"
+
+SYN_DATA_PATH="${DATA_PATH}synthetic/"
+
+RESULT_PATH="../results/threads/"
+
+mkdir ${RESULT_PATH}
+
+
+# build time as a function of the number of build threads
+data="${SYN_DATA_PATH}uniform_20m_2_1"
+for threads in 1 2 4 8 16 32
+do
+    for index in "zm" "mli" "lisa" "flood"
+    do
+        echo "Benchmark ${index} dataset ${data} threads=${threads}"
+        "${BENCH_BIN_PATH}bench2d_default" $index $data 20000000 range $threads > "${RESULT_PATH}${index}_uniform_t${threads}"
+    done
+done
+
+for index in "zm" "mli" "lisa" "flood"
+do
+    echo "Build time of ${index} [threads ms]"
+    for threads in 1 2 4 8 16 32
+    do
+        echo "${threads} $(grep "Build Time" "${RESULT_PATH}${index}_uniform_t${threads}" | grep -o "[0-9]*")"
+    done
+done
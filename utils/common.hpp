@@ -2,6 +2,7 @@
 
 #include "type.hpp"
 #include "datautils.hpp"
+#include <algorithm>
 #include <array>
 #include <bits/types/struct_rusage.h>
 #include <boost/geometry/algorithms/detail/distance/interface.hpp>
@@ -11,6 +12,7 @@
 #include <cstddef>
 #include <deque>
 #include <iostream>
+#include <limits>
 #include <map>
 #include <queue>
 #include <sys/resource.h>
@@ -50,6 +52,18 @@ inline bool is_in_box(point_t<dim>& p, box_t<dim>& box) {
 }
 
 
+// whether p is within the box on the dimensions whose bits are set in mask
+template<size_t dim>
+inline bool is_in_box_on(point_t<dim>& p, box_t<dim>& box, uint32_t mask) {
+    for (size_t d=0; d<dim; ++d) {
+        if (((mask >> d) & 1) && (p[d] < box.min_corner()[d] || p[d] > box.max_corner()[d])) {
+            return false;
+        }
+    }
+    return true;
+}
+
+
 template<size_t dim>
 inline double eu_dist_square(point_t<dim>& p1, point_t<dim>& p2) {
     double acc = 0;
@@ -124,6 +138,297 @@ inline void print_knn_result(point_t<dim>& q, vec_of_point_t<dim>& knn) {
 }
 
 
+// best-first traversal of the cells of a GDim-dimensional grid in increasing distance from a query point
+// starting from the cell of the query, the neighbors of visited cells are expanded with a priority queue
+// every cell is reached from a neighbor that is not farther from the query, so cells are visited in order
+// visited cells are marked with the id of the current search, so the marks never need to be cleared
+template<size_t GDim>
+class GridBestFirst {
+public:
+    using Coords = std::array<size_t, GDim>;
+
+    GridBestFirst() = default;
+
+    // columns: number of columns on each dimension, cell id = sum of coords[d] * (product of columns before d)
+    explicit GridBestFirst(const Coords& columns) : columns(columns), search_id(0) {
+        size_t total = 1;
+        for (size_t d=0; d<GDim; ++d) {
+            strides[d] = total;
+            total *= columns[d];
+        }
+        stamps.assign(total, 0);
+    }
+
+    // bounds(d, idx) returns the [lo, hi] extent of column idx on dimension d
+    // visit(cell_id, coords, min_dist_square) is called in increasing min_dist_square and returns false to stop
+    template<typename BoundsFn, typename VisitFn>
+    void search(const std::array<double, GDim>& q, const Coords& start, BoundsFn bounds, VisitFn visit) {
+        if (++search_id == 0) {
+            std::fill(stamps.begin(), stamps.end(), 0);
+            search_id = 1;
+        }
+
+        using Entry = std::pair<double, Coords>;
+        auto cmp = [](const Entry& a, const Entry& b) { return a.first > b.first; };
+        std::priority_queue<Entry, std::vector<Entry>, decltype(cmp)> queue(cmp);
+
+        auto push = [&](const Coords& coords) {
+            size_t id = cell_id(coords);
+            if (stamps[id] == search_id) {
+                return;
+            }
+            stamps[id] = search_id;
+
+            double acc = 0.0;
+            for (size_t d=0; d<GDim; ++d) {
+                auto [lo, hi] = bounds(d, coords[d]);
+                double delta = (q[d] < lo) ? (lo - q[d]) : ((q[d] > hi) ? (q[d] - hi) : 0.0);
+                acc += delta * delta;
+            }
+            queue.emplace(acc, coords);
+        };
+
+        push(start);
+        while (!queue.empty()) {
+            auto [dist_square, coords] = queue.top();
+            queue.pop();
+
+            if (!visit(cell_id(coords), coords, dist_square)) {
+                return;
+            }
+
+            for (size_t d=0; d<GDim; ++d) {
+                if (coords[d] > 0) {
+                    coords[d]--;
+                    push(coords);
+                    coords[d]++;
+                }
+                if (coords[d] + 1 < columns[d]) {
+                    coords[d]++;
+                    push(coords);
+                    coords[d]--;
+                }
+            }
+        }
+    }
+
+    inline size_t cell_id(const Coords& coords) const {
+        size_t id = 0;
+        for (size_t d=0; d<GDim; ++d) {
+            id += coords[d] * strides[d];
+        }
+        return id;
+    }
+
+    inline size_t size_in_bytes() const {
+        return stamps.size() * sizeof(uint32_t);
+    }
+
+private:
+    Coords columns;
+    Coords strides;
+    std::vector<uint32_t> stamps;
+    uint32_t search_id;
+};
+
+
+// the cells of a grid intersected by a query box are classified as covered by the box, cut by it, or empty
+// on each dimension only the first and the last intersected columns can be cut, i.e., the extent of their points
+// on the dimension is not contained in the query range
+struct ColumnSpan {
+    size_t lo, hi;
+    bool cut_lo, cut_hi;
+};
+
+// a run of consecutive cells, bit d of mask is set if dimension d cuts the cells of the run
+struct CellRun {
+    size_t first, last;
+    uint32_t mask;
+};
+
+// the span of the intersected columns [lo, hi] of a dimension given the extents [col_min[j], col_max[j]]
+// of the points in each column (empty columns have col_min=+inf and col_max=-inf)
+// columns without any point in [q_lo, q_hi] are dropped from both ends, returns false if no column is left
+inline bool column_span(size_t lo, size_t hi, double q_lo, double q_hi, const double* col_min, const double* col_max, ColumnSpan& span) {
+    while (lo <= hi && col_max[lo] < q_lo) {
+        ++lo;
+    }
+    while (hi > lo && col_min[hi] > q_hi) {
+        --hi;
+    }
+    if (lo > hi || col_min[hi] > q_hi) {
+        return false;
+    }
+
+    span.lo = lo;
+    span.hi = hi;
+    span.cut_lo = (col_min[lo] < q_lo) || (col_max[lo] > q_hi);
+    span.cut_hi = (col_min[hi] < q_lo) || (col_max[hi] > q_hi);
+    return true;
+}
+
+// odometer over the cells within the spans of all dimensions, f(first, last, mask) is called for every run of consecutive cells
+// cell id = sum of idx[d] * dim_offset[d] with dim_offset[0] = 1, so cells are consecutive along dimension 0
+// and every row of dimension 0 is one run, except that a cut first or last column gets its own run
+// nothing is allocated, the runs are produced in increasing cell order
+template<size_t Dim, typename F>
+inline void for_each_cell_run(const std::array<ColumnSpan, Dim>& spans, const std::array<size_t, Dim>& dim_offset, F f) {
+    assert(dim_offset[0] == 1);
+
+    // bit d of the mask if column i of dimension d is cut
+    auto cut_bit = [&spans](size_t d, size_t i) {
+        return (((i == spans[d].lo) && spans[d].cut_lo) || ((i == spans[d].hi) && spans[d].cut_hi)) ? (1u << d) : 0u;
+    };
+
+    // the mask of the dimensions 1, ..., Dim-1 is updated along with the odometer
+    std::array<size_t, Dim> idx;
+    size_t base = 0;
+    uint32_t mask = 0;
+    for (size_t d=1; d<Dim; ++d) {
+        idx[d] = spans[d].lo;
+        base += idx[d] * dim_offset[d];
+        mask |= cut_bit(d, idx[d]);
+    }
+
+    const auto& row = spans[0];
+    while (true) {
+        if (row.lo == row.hi) {
+            f(base + row.lo, base + row.lo, mask | ((row.cut_lo || row.cut_hi) ? 1u : 0u));
+        } else {
+            size_t first = row.lo, last = row.hi;
+            if (row.cut_lo) {
+                f(base + first, base + first, mask | 1u);
+                ++first;
+            }
+            if (row.cut_hi) {
+                --last;
+            }
+            if (first <= last) {
+                f(base + first, base + last, mask);
+            }
+            if (row.cut_hi) {
+                f(base + row.hi, base + row.hi, mask | 1u);
+            }
+        }
+
+        // advance the odometer on dimensions 1, ..., Dim-1
+        size_t d = 1;
+        for (; d<Dim; ++d) {
+            if (idx[d] < spans[d].hi) {
+                idx[d]++;
+                base += dim_offset[d];
+                mask = (mask & ~(1u << d)) | cut_bit(d, idx[d]);
+                break;
+            }
+            base -= (idx[d] - spans[d].lo) * dim_offset[d];
+            idx[d] = spans[d].lo;
+            mask = (mask & ~(1u << d)) | cut_bit(d, idx[d]);
+        }
+        if (d == Dim) {
+            return;
+        }
+    }
+}
+
+// the runs of cells within the spans of all dimensions, collected into runs
+template<size_t Dim>
+inline void cell_runs(const std::array<ColumnSpan, Dim>& spans, const std::array<size_t, Dim>& dim_offset, std::vector<CellRun>& runs) {
+    // every row of dimension 0 has the same number of runs
+    const auto& row = spans[0];
+    size_t count = (row.lo == row.hi) ? 1 : (row.cut_lo ? 1 : 0) + (row.cut_hi ? 1 : 0)
+        + ((row.hi - row.lo + 1 > size_t(row.cut_lo) + size_t(row.cut_hi)) ? 1 : 0);
+    for (size_t d=1; d<Dim; ++d) {
+        count *= spans[d].hi - spans[d].lo + 1;
+    }
+
+    runs.resize(count);
+    CellRun* out = runs.data();
+    for_each_cell_run(spans, dim_offset, [&out](size_t first, size_t last, uint32_t mask) {
+        out->first = first;
+        out->last = last;
+        out->mask = mask;
+        ++out;
+    });
+}
+
+// a per-thread buffer for cell runs, reused across queries so that range queries do not allocate it
+inline std::vector<CellRun>& cell_run_scratch() {
+    thread_local std::vector<CellRun> runs;
+    return runs;
+}
+
+// the extent of the points in [first, last) of every column on each dimension, col_idx(p, d) is the column of p on dimension d
+// the extents are reset first, empty columns keep col_min=+inf and col_max=-inf
+template<size_t Dim, typename It, typename ColIdx, typename Cols>
+inline void column_extents(It first, It last, ColIdx col_idx, Cols& col_mins, Cols& col_maxs) {
+    for (auto& col : col_mins) {
+        std::fill(col.begin(), col.end(), std::numeric_limits<double>::infinity());
+    }
+    for (auto& col : col_maxs) {
+        std::fill(col.begin(), col.end(), -std::numeric_limits<double>::infinity());
+    }
+    for (auto it=first; it!=last; ++it) {
+        for (size_t i=0; i<Dim; ++i) {
+            auto idx = col_idx(*it, i);
+            col_mins[i][idx] = std::min(col_mins[i][idx], (*it)[i]);
+            col_maxs[i][idx] = std::max(col_maxs[i][idx], (*it)[i]);
+        }
+    }
+}
+
+// range query over the cells of a grid with the column extents col_mins and col_maxs
+// the columns that intersect the box are located by col_idx(corner, d) on each dimension, except on fixed_dim
+// which has a single column and is never cut (e.g., the sort dimension of Flood)
+// the result is reserved for run_size(first, last) points of every run of intersected cells,
+// then scan(cell, mask) appends the points of every cell in the box, bit d of mask is set if dimension d cuts the cell
+template<size_t Dim, typename Box, typename Result, typename ColIdx, typename Cols, typename RunSize, typename Scan>
+inline void grid_range_scan(Box& box, ColIdx col_idx, const Cols& col_mins, const Cols& col_maxs,
+                            const std::array<size_t, Dim>& dim_offset, Result& result, RunSize run_size, Scan scan, size_t fixed_dim = Dim) {
+    std::array<ColumnSpan, Dim> spans;
+    for (size_t i=0; i<Dim; ++i) {
+        if (i == fixed_dim) {
+            spans[i] = {0, 0, false, false};
+            continue;
+        }
+        if (!column_span(col_idx(box.min_corner(), i), col_idx(box.max_corner(), i),
+                box.min_corner()[i], box.max_corner()[i], col_mins[i].data(), col_maxs[i].data(), spans[i])) {
+            return;
+        }
+    }
+
+    auto& runs = cell_run_scratch();
+    cell_runs(spans, dim_offset, runs);
+
+    // the points of the intersected cells bound the result size
+    size_t candidates = 0;
+    for (auto& run : runs) {
+        candidates += run_size(run.first, run.last);
+    }
+    result.reserve(candidates);
+
+    for (auto& run : runs) {
+        for (auto idx=run.first; idx<=run.last; ++idx) {
+            scan(idx, run.mask);
+        }
+    }
+}
+
+// append the points of a cell in [first, last) that are in the box
+// a cell covered by the box (mask 0) is copied as a whole, the others are refined on the dimensions that cut them
+template<size_t Dim, typename It>
+inline void emit_cell_points(std::vector<point_t<Dim>>& result, It first, It last, box_t<Dim>& box, uint32_t mask) {
+    if (mask == 0) {
+        result.insert(result.end(), first, last);
+        return;
+    }
+    for (auto it=first; it!=last; ++it) {
+        if (is_in_box_on(*it, box, mask)) {
+            result.emplace_back(*it);
+        }
+    }
+}
+
+
 // Boost rtree visitor to compute rtree statistics
 template <typename Value, typename Options, typename Box, typename Allocators>
 struct statistics : public boost::geometry::index::detail::rtree::visitor<Value, typename Options::parameters_type, Box, Allocators, typename Options::node_tag, true>::type
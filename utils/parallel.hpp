@@ -0,0 +1,325 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <iterator>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+namespace bench { namespace common {
+
+// number of threads used when building indexes
+// 0 (default) means one thread per hardware core
+inline size_t& build_threads_setting() {
+    static size_t threads = 0;
+    return threads;
+}
+
+// also caps the OpenMP team used by the PGM segmentation of the calling thread,
+// this setting is per thread, so the workers of parallel_for and parallel_tasks run theirs serially
+inline void set_build_threads(size_t threads) {
+    build_threads_setting() = threads;
+#ifdef _OPENMP
+    if (threads > 0) {
+        omp_set_num_threads(static_cast<int>(threads));
+    }
+#endif
+}
+
+inline size_t build_threads() {
+    size_t threads = build_threads_setting();
+    if (threads == 0) {
+        threads = std::max<size_t>(1, std::thread::hardware_concurrency());
+    }
+    return threads;
+}
+
+// run OpenMP regions of the current thread serially within a scope, and restore the team size after it
+// the workers of parallel_for and parallel_tasks already use every build thread,
+// an OpenMP team started by each of them would oversubscribe the cores
+struct SerialOmpScope {
+#ifdef _OPENMP
+    int saved;
+    SerialOmpScope() : saved(omp_get_max_threads()) {
+        omp_set_num_threads(1);
+    }
+    ~SerialOmpScope() {
+        omp_set_num_threads(saved);
+    }
+#endif
+};
+
+
+// run f(begin, end) over [0, n) split into one contiguous chunk per thread
+// chunks smaller than grain are not worth a thread, so small inputs run inline
+template<typename F>
+void parallel_for(size_t n, F f, size_t grain = 1 << 14) {
+    size_t threads = std::min(build_threads(), (n + grain - 1) / std::max<size_t>(grain, 1));
+    if (threads <= 1) {
+        if (n > 0) {
+            f(size_t(0), n);
+        }
+        return;
+    }
+
+    size_t chunk = (n + threads - 1) / threads;
+    std::vector<std::thread> workers;
+    workers.reserve(threads - 1);
+    for (size_t t=1; t<threads; ++t) {
+        size_t lo = std::min(n, t * chunk);
+        size_t hi = std::min(n, lo + chunk);
+        workers.emplace_back([&f, lo, hi]() { SerialOmpScope serial; if (lo < hi) f(lo, hi); });
+    }
+    {
+        SerialOmpScope serial;
+        f(size_t(0), std::min(n, chunk));
+    }
+
+    for (auto& w : workers) {
+        w.join();
+    }
+}
+
+
+// run f(i) for every task i in [0, n)
+// workers pull tasks one at a time, so tasks of very different cost (e.g., fitting
+// many small models of skewed sizes) are still balanced across threads
+template<typename F>
+void parallel_tasks(size_t n, F f) {
+    size_t threads = std::min(build_threads(), n);
+    if (threads <= 1) {
+        for (size_t i=0; i<n; ++i) {
+            f(i);
+        }
+        return;
+    }
+
+    std::atomic<size_t> next(0);
+    auto worker = [&f, &next, n]() {
+        SerialOmpScope serial;
+        for (size_t i=next++; i<n; i=next++) {
+            f(i);
+        }
+    };
+
+    std::vector<std::thread> workers;
+    workers.reserve(threads - 1);
+    for (size_t t=1; t<threads; ++t) {
+        workers.emplace_back(worker);
+    }
+    worker();
+
+    for (auto& w : workers) {
+        w.join();
+    }
+}
+
+
+// parallel sample sort
+// splitters are drawn from a regular sample, every thread scatters its chunk into the buckets
+// and the buckets are then sorted independently
+template<typename T, typename Compare = std::less<T>>
+void parallel_sort(std::vector<T>& v, Compare comp = Compare()) {
+    const size_t n = v.size();
+    const size_t threads = build_threads();
+    if (threads <= 1 || n < (size_t(1) << 16)) {
+        std::sort(v.begin(), v.end(), comp);
+        return;
+    }
+
+    // oversample to keep the buckets balanced
+    const size_t buckets = threads * 4;
+    const size_t oversampling = 32;
+    std::vector<T> sample;
+    sample.reserve(buckets * oversampling);
+    size_t stride = n / (buckets * oversampling);
+    for (size_t i=0; i<buckets*oversampling; ++i) {
+        sample.emplace_back(v[i * stride]);
+    }
+    std::sort(sample.begin(), sample.end(), comp);
+
+    std::vector<T> splitters;
+    splitters.reserve(buckets - 1);
+    for (size_t b=1; b<buckets; ++b) {
+        splitters.emplace_back(sample[b * oversampling]);
+    }
+
+    // per chunk histograms of bucket ids
+    const size_t chunk = (n + threads - 1) / threads;
+    std::vector<uint32_t> bucket_of(n);
+    std::vector<std::vector<size_t>> counts(threads, std::vector<size_t>(buckets, 0));
+
+    parallel_for(threads, [&](size_t t_lo, size_t t_hi) {
+        for (size_t t=t_lo; t<t_hi; ++t) {
+            size_t lo = std::min(n, t * chunk), hi = std::min(n, lo + chunk);
+            for (size_t i=lo; i<hi; ++i) {
+                auto b = std::upper_bound(splitters.begin(), splitters.end(), v[i], comp) - splitters.begin();
+                bucket_of[i] = static_cast<uint32_t>(b);
+                counts[t][b]++;
+            }
+        }
+    }, 1);
+
+    // bucket-major prefix sums give every chunk its own slot in each bucket
+    std::vector<size_t> bucket_begin(buckets + 1, 0);
+    size_t acc = 0;
+    for (size_t b=0; b<buckets; ++b) {
+        bucket_begin[b] = acc;
+        for (size_t t=0; t<threads; ++t) {
+            size_t c = counts[t][b];
+            counts[t][b] = acc;
+            acc += c;
+        }
+    }
+    bucket_begin[buckets] = acc;
+
+    std::vector<T> out(n);
+    parallel_for(threads, [&](size_t t_lo, size_t t_hi) {
+        for (size_t t=t_lo; t<t_hi; ++t) {
+            size_t lo = std::min(n, t * chunk), hi = std::min(n, lo + chunk);
+            for (size_t i=lo; i<hi; ++i) {
+                out[counts[t][bucket_of[i]]++] = std::move(v[i]);
+            }
+        }
+    }, 1);
+
+    parallel_for(buckets, [&](size_t b_lo, size_t b_hi) {
+        for (size_t b=b_lo; b<b_hi; ++b) {
+            std::sort(out.begin() + bucket_begin[b], out.begin() + bucket_begin[b+1], comp);
+        }
+    }, 1);
+
+    v.swap(out);
+}
+
+
+// the sort-based build pipeline shared by learned indexes:
+// compute a 1-D key per point in parallel, sort (key, row id) pairs
+// and return them in key order, ties are broken by row id
+template<typename Key, typename Point, typename KeyFn>
+std::vector<std::pair<Key, size_t>> sort_by_key(std::vector<Point>& points, KeyFn key_fn) {
+    std::vector<std::pair<Key, size_t>> keyed(points.size());
+    parallel_for(points.size(), [&](size_t lo, size_t hi) {
+        for (size_t i=lo; i<hi; ++i) {
+            keyed[i] = std::make_pair(static_cast<Key>(key_fn(points[i])), i);
+        }
+    });
+
+    parallel_sort(keyed);
+    return keyed;
+}
+
+// move the items of [first, last) to their sorted positions at every multiple of step from first
+// and partition the items in between, by recursive selection of the middle cut
+template<typename It, typename Compare>
+void select_cuts(It first, It last, size_t step, Compare comp) {
+    const size_t n = last - first;
+    if (n <= step) {
+        return;
+    }
+    const size_t cuts = (n - 1) / step;
+    It mid = first + ((cuts + 1) / 2) * step;
+    std::nth_element(first, mid, last, comp);
+    select_cuts(first, mid, step, comp);
+    select_cuts(mid, last, step, comp);
+}
+
+// sort-tile-recursive (STR) partitioning for bulk-loading
+// the items are cut into slabs on the first dimension, every slab is cut on the second dimension and so on,
+// the slabs of the last dimension hold leaf_size items and are the leaves
+// the slabs are only partitioned at their boundaries, the items within a leaf are in no particular order
+// coord(item, d) is the coordinate of an item on dimension d, the items are reordered in place
+// slabs[d] holds the first position of every slab on dimension d followed by the number of items,
+// the slabs of a level are cut concurrently
+template<size_t Dim, typename T, typename Coord>
+std::array<std::vector<size_t>, Dim> str_partition(std::vector<T>& items, size_t leaf_size, Coord coord) {
+    const size_t n = items.size();
+    const size_t leaves = std::max<size_t>(1, (n + leaf_size - 1) / leaf_size);
+    const size_t fanout = std::max<size_t>(1, static_cast<size_t>(std::ceil(std::pow(static_cast<double>(leaves), 1.0 / Dim))));
+
+    std::array<std::vector<size_t>, Dim> slabs;
+    std::vector<size_t> parents = {0, n};
+    for (size_t d=0; d<Dim; ++d) {
+        // a slab on dimension d holds the items of the leaves it is cut into on the remaining dimensions
+        size_t slab_size = leaf_size;
+        for (size_t i=d+1; i<Dim; ++i) {
+            slab_size *= fanout;
+        }
+
+        auto by_dim = [&coord, d](const T& a, const T& b) { return coord(a, d) < coord(b, d); };
+        parallel_tasks(parents.size() - 1, [&](size_t r) {
+            select_cuts(items.begin() + parents[r], items.begin() + parents[r+1], slab_size, by_dim);
+        });
+        for (size_t r=0; r+1<parents.size(); ++r) {
+            for (size_t lo=parents[r]; lo<parents[r+1]; lo+=slab_size) {
+                slabs[d].emplace_back(lo);
+            }
+        }
+        slabs[d].emplace_back(n);
+        parents = slabs[d];
+    }
+
+    return slabs;
+}
+
+// sort-tile-recursive tiling of [first, last) into tiles of tile_size items, without threads
+// the slabs on every dimension are cut at multiples of tile_size, so every tile_size consecutive items
+// from first form one tile and only the last tile is partial
+// (str_partition leaves a partial leaf at the end of every slab instead)
+template<size_t Dim, typename It, typename Coord>
+void str_tile(It first, It last, size_t tile_size, Coord coord, size_t d = 0) {
+    const size_t n = last - first;
+    const size_t tiles = (n + tile_size - 1) / tile_size;
+    if (tiles <= 1 || d == Dim) {
+        return;
+    }
+
+    // the tiles are spread evenly over the remaining dimensions
+    const size_t fanout = std::max<size_t>(1, static_cast<size_t>(std::ceil(std::pow(static_cast<double>(tiles), 1.0 / (Dim - d)))));
+    const size_t slab_size = tile_size * ((tiles + fanout - 1) / fanout);
+
+    using T = typename std::iterator_traits<It>::value_type;
+    auto by_dim = [&coord, d](const T& a, const T& b) { return coord(a, d) < coord(b, d); };
+    select_cuts(first, last, slab_size, by_dim);
+    for (size_t lo=0; lo<n; lo+=slab_size) {
+        str_tile<Dim>(first + lo, first + std::min(n, lo + slab_size), tile_size, coord, d + 1);
+    }
+}
+
+// gather points (and their keys) in the order given by sort_by_key
+template<typename Key, typename Point>
+void gather(const std::vector<Point>& points, const std::vector<std::pair<Key, size_t>>& order,
+            std::vector<Point>& sorted_points, std::vector<Key>& sorted_keys) {
+    sorted_points.resize(order.size());
+    sorted_keys.resize(order.size());
+    parallel_for(order.size(), [&](size_t lo, size_t hi) {
+        for (size_t i=lo; i<hi; ++i) {
+            sorted_points[i] = points[order[i].second];
+            sorted_keys[i] = order[i].first;
+        }
+    });
+}
+
+// gather only the points, for callers that do not keep the keys
+template<typename Key, typename Point>
+void gather(const std::vector<Point>& points, const std::vector<std::pair<Key, size_t>>& order,
+            std::vector<Point>& sorted_points) {
+    sorted_points.resize(order.size());
+    parallel_for(order.size(), [&](size_t lo, size_t hi) {
+        for (size_t i=lo; i<hi; ++i) {
+            sorted_points[i] = points[order[i].second];
+        }
+    });
+}
+
+}}